@@ -34,10 +34,70 @@
 
 #include<stdio.h>
 #include<stdlib.h>
+#include<stdarg.h>
 #include<string.h>
+#include<errno.h>
+#include<fcntl.h>
 #include<unistd.h>
+#include<signal.h>
+#include<poll.h>
+#include<sys/ioctl.h>
+#include<sys/epoll.h>
 #include"cmdline.h"
 
+/*
+* 内部函数 输出缓冲区扩容 首次为OUTPUT_BUF_MAX_SIZE 之后按2倍扩容
+* 返回0为成功 -1为失败(已达OUTPUT_BUF_LIMIT或内存不足)
+*/
+static int
+cmdline_out_reserve(struct cmdline* cl)
+{
+    unsigned int size = cl->out_cap ? cl->out_cap * 2 : OUTPUT_BUF_MAX_SIZE;
+    char* tmp;
+
+    if(size > OUTPUT_BUF_LIMIT)
+        return -1;
+    tmp = realloc(cl->out_buf, size);
+    if(tmp == NULL)
+        return -1;
+    cl->out_buf = tmp;
+    cl->out_cap = size;
+    return 0;
+}
+
+/*
+* 内部函数 将内容写入输出缓冲区
+* 缓冲区已满时先进行flush 输出流暂时不可写时扩容 剩余内容由EPOLLOUT时输出
+* 返回写入的长度
+* 返回-1说明有内容被丢弃 即超出OUTPUT_BUF_LIMIT的部分或输出流出错时缓冲区中的内容
+*/
+static int
+cmdline_write_buf(struct cmdline* cl, const char* buf, unsigned int size)
+{
+    unsigned int done = 0, n;
+    int lost = 0;
+
+    while(done < size)
+    {
+        //缓冲区已满 先尝试输出 输出流暂时不可写(或尚未分配)时扩容
+        //输出流出错时缓冲区被清空
+        if(cl->out_len == cl->out_cap)
+        {
+            if(cmdline_flush(cl) < 0 && cl->out_len == 0)
+                lost = 1;
+            if(cl->out_len == cl->out_cap && cmdline_out_reserve(cl) < 0)
+                return -1;
+        }
+        n = cl->out_cap - cl->out_len;
+        if(n > size - done)
+            n = size - done;
+        memcpy(cl->out_buf + cl->out_len, buf + done, n);
+        cl->out_len += n;
+        done += n;
+    }
+    return lost ? -1 : (int)done;
+}
+
 /*
 * 内部函数 输出字符串
 */
@@ -47,14 +107,12 @@ cmdline_puts(struct cmdline* cl, const char* str)
     if(!cl || !str)
         return;
 
-    size_t len = strnlen(str, INPUT_BUF_MAX_SIZE), i;
-    for(i = 0; i < len; ++i)
-        if(cl->cmdline_out >= 0)
-            write(cl->cmdline_out, &str[i], 1);
+    cmdline_write_buf(cl, str, strlen(str));
 }
 
 /*
 * 内部函数 字符输出
+* 字符先写入输出缓冲区 由cmdline_flush()统一输出
 */
 static int
 cmdline_write_char(struct receiver* recv, char c)
@@ -62,14 +120,13 @@ cmdline_write_char(struct receiver* recv, char c)
     if(!recv)
         return -1;
     
-    int ret= -1;
     struct cmdline *cl;
     
     cl = recv->owner;
-    if(cl->cmdline_out >= 0)
-        ret = write(cl->cmdline_out, &c, 1);
+    if(cl->cmdline_out < 0)
+        return -1;
     
-    return ret;
+    return cmdline_write_buf(cl, &c, 1) == 1 ? 1 : -1;
 }
 
 /*
@@ -80,6 +137,8 @@ cmdline_parse_cmd(struct receiver* recv, const char* cmd)
 {
     struct cmdline* cl = recv->owner;
     int ret;
+    //回调函数可能直接输出 先输出缓冲区中已有内容(包括回显的命令)
+    cmdline_flush_wait(cl);
     ret = parse(cl, cmd);
     if(ret == PARSE_AMBIGUOUS)
         cmdline_puts(cl, "Ambiguous command\n");
@@ -93,48 +152,179 @@ cmdline_parse_cmd(struct receiver* recv, const char* cmd)
 * 内部函数 补全命令
 */
 static int
-cmdline_complete_cmd(struct receiver* recv, const char* buf, int* state, char* dst, unsigned int size)
+cmdline_complete_cmd(struct receiver* recv, const char* buf, int help, struct complete_result* res)
 {
     struct cmdline* cl = recv->owner;
-    return complete(cl, buf, state, dst, size);
+    return complete(cl, buf, help, res);
 }
 
-struct cmdline* 
-cmdline_get_new(parse_ctx_t* ctx, const char* prompt)
+/*
+* 终端窗口大小改变(SIGWINCH)的标记 处理输入时重新查询宽度
+*/
+static volatile sig_atomic_t cmdline_winch = 0;
+
+static void
+cmdline_on_winch(int sig)
+{
+    (void)sig;
+    cmdline_winch = 1;
+}
+
+/*
+* 内部函数 查询终端宽度并设置至接收器
+*/
+static void
+cmdline_update_width(struct cmdline* cl)
+{
+    struct winsize ws;
+
+    if(ioctl(cl->cmdline_out, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0)
+        receiver_set_width(&cl->cmd_recv, ws.ws_col);
+}
+
+/*
+* 内部函数 终端窗口大小改变后重新查询宽度 只处理修改过终端设置的cmdline
+*/
+static void
+cmdline_check_winch(struct cmdline* cl)
+{
+    if(!cl->term_saved || !cmdline_winch)
+        return;
+    cmdline_winch = 0;
+    cmdline_update_width(cl);
+    cmdline_flush(cl);
+}
+
+/*
+* 内部函数 分配并初始化cmdline 不启动接收器
+* idx不为NULL时共享此命令索引 否则由ctx编译
+*/
+static struct cmdline*
+cmdline_alloc(struct parse_index* idx, parse_ctx_t* ctx, const char* prompt, int in, int out)
 {
-	if (!prompt)
+    if(!prompt)
         return NULL;
-    
+
     struct cmdline *cl;
-    struct termios term;
-    
+    int size;
+
+    //命令组的解析结果长度 有误时无法新建
+    size = idx ? (int)idx->result_size : parse_ctx_result_size(ctx);
+    if(size < 0)
+        return NULL;
+
     //cmdline内存初始化
     cl = malloc(sizeof(struct cmdline));
     if(cl == NULL)
         return NULL;
     memset(cl, 0, sizeof(struct cmdline));
+
+    //解析结果缓冲区 每次解析重复使用
+    cl->result_size = size;
+    cl->result_buf = malloc(size > 0 ? size : 1);
+    if(cl->result_buf == NULL)
+    {
+        free(cl);
+        return NULL;
+    }
     
-    //cmdline成员初始化
-    cl->cmd_group = ctx;
-    cl->cmdline_in = INPUT_STREAM;
-    cl->cmdline_out = OUTPUT_STREAM;
+    //cmdline成员初始化 命令索引编译失败时遍历命令组进行解析
+    if(idx)
+    {
+        cl->cmd_group = idx->ctx;
+        cl->cmd_index = parse_index_get(idx);
+    }
+    else
+    {
+        cl->cmd_group = ctx;
+        cl->cmd_index = parse_index_new(ctx);
+    }
+    cl->cmdline_in = in;
+    cl->cmdline_out = out;
+    cl->epoll_fd = -1;
     cmdline_set_prompt(cl, prompt);
     receiver_init(&cl->cmd_recv, cmdline_write_char, cmdline_parse_cmd, cmdline_complete_cmd);
     cl->cmd_recv.owner = cl;
-    tcgetattr(0, &term);
-    memcpy(&cl->oldterm, &term, sizeof(struct termios));
     
-    //终端配置设置
-    term.c_lflag &= ~(ICANON | ECHO | ISIG);
-    tcsetattr(0, TCSANOW, &term);
+    return cl;
+}
+
+struct cmdline* 
+cmdline_get_new(parse_ctx_t* ctx, const char* prompt)
+{
+    struct cmdline *cl;
+    struct termios term;
+    struct sigaction sa;
+    
+    cl = cmdline_alloc(NULL, ctx, prompt, INPUT_STREAM, OUTPUT_STREAM);
+    if(cl == NULL)
+        return NULL;
+    
+    //终端配置备份
+    if(tcgetattr(cl->cmdline_in, &term) == 0)
+    {
+        memcpy(&cl->oldterm, &term, sizeof(struct termios));
+        cl->term_saved = 1;
+    
+        //终端配置设置
+        term.c_lflag &= ~(ICANON | ECHO | ISIG);
+        tcsetattr(cl->cmdline_in, TCSANOW, &term);
+        cmdline_set_bracketed_paste(cl, RECEIVER_PASTE_INSERT);
+
+        //终端宽度 窗口大小改变时在下一次处理输入前重新查询
+        //SA_RESTART避免应用中阻塞的系统调用被打断 原有的处理方式在退出时恢复
+        cmdline_update_width(cl);
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = cmdline_on_winch;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        if(sigaction(SIGWINCH, &sa, &cl->old_winch) == 0)
+            cl->winch_saved = 1;
+    }
     setbuf(stdin, NULL);
     
     //启动命令行接收器
     receiver_new_cmdline(&cl->cmd_recv, prompt);
+    cmdline_flush(cl);
     
     return cl;
 }
 
+struct cmdline*
+cmdline_get_new_fd(parse_ctx_t* ctx, const char* prompt, int in, int out)
+{
+    struct cmdline *cl;
+
+    cl = cmdline_alloc(NULL, ctx, prompt, in, out);
+    if(cl == NULL)
+        return NULL;
+
+    //启动命令行接收器
+    receiver_new_cmdline(&cl->cmd_recv, prompt);
+    cmdline_flush(cl);
+
+    return cl;
+}
+
+struct cmdline*
+cmdline_get_new_index(struct parse_index* idx, const char* prompt, int in, int out)
+{
+    if(!idx)
+        return NULL;
+
+    struct cmdline *cl;
+
+    cl = cmdline_alloc(idx, NULL, prompt, in, out);
+    if(cl == NULL)
+        return NULL;
+
+    //启动命令行接收器
+    receiver_new_cmdline(&cl->cmd_recv, prompt);
+    cmdline_flush(cl);
+
+    return cl;
+}
+
 void
 cmdline_set_prompt(struct cmdline* cl, const char* prompt)
 {
@@ -155,23 +345,272 @@ cmdline_set_prompt(struct cmdline* cl, const char* prompt)
     cl->prompt[len] = '\0';
 }
 
+int
+cmdline_set_history_file(struct cmdline* cl, const char* path, int sync)
+{
+    if(!cl || !path)
+        return -1;
+    return history_load_file(&cl->cmd_recv.hist, path, sync);
+}
+
+int
+cmdline_set_history_dedup(struct cmdline* cl, int mode)
+{
+    if(!cl)
+        return -1;
+    return history_set_dedup(&cl->cmd_recv.hist, mode);
+}
+
+int
+cmdline_set_history_shared(struct cmdline* cl, struct history_shared* shared)
+{
+    if(!cl || !shared)
+        return -1;
+    return history_attach_shared(&cl->cmd_recv.hist, shared);
+}
+
+int
+cmdline_set_line_max(struct cmdline* cl, unsigned int max)
+{
+    if(!cl)
+        return -1;
+    return receiver_set_line_max(&cl->cmd_recv, max) < 0 ? -1 : 0;
+}
+
+int
+cmdline_set_width(struct cmdline* cl, unsigned int cols)
+{
+    if(!cl)
+        return -1;
+    receiver_set_width(&cl->cmd_recv, cols);
+    cmdline_flush(cl);
+    return 0;
+}
+
+int
+cmdline_set_bracketed_paste(struct cmdline* cl, int mode)
+{
+    if(!cl || mode < RECEIVER_PASTE_OFF || mode > RECEIVER_PASTE_EXEC)
+        return -1;
+
+    //开启/关闭终端的括号粘贴
+    if(mode != RECEIVER_PASTE_OFF && cl->cmd_recv.paste_mode == RECEIVER_PASTE_OFF)
+        cmdline_puts(cl, vt102_paste_on);
+    else if(mode == RECEIVER_PASTE_OFF && cl->cmd_recv.paste_mode != RECEIVER_PASTE_OFF)
+        cmdline_puts(cl, vt102_paste_off);
+    cl->cmd_recv.paste_mode = mode;
+    cmdline_flush(cl);
+    return 0;
+}
+
 void
 cmdline_start_interact(struct cmdline* cl)
 {
     if(!cl)
         return;
     
-    char c = -1;
+    char buf[INPUT_READ_CHUNK_SIZE];
+    ssize_t n;
     
+    //按块读取 粘贴的内容一次read即可整体交给cmdline_parse_input
     while(1)
     {
-        if(read(cl->cmdline_in, &c, 1) <= 0)
+        n = read(cl->cmdline_in, buf, sizeof(buf));
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
             break;
-        if(cmdline_parse_input(cl, &c, 1) < 0)
+        if(cmdline_parse_input(cl, buf, n) < 0)
             break;
     }
 }
 
+int
+cmdline_get_fd(struct cmdline* cl)
+{
+    if(!cl)
+        return -1;
+    return cl->cmdline_in;
+}
+
+/*
+* 内部函数 设置fd的O_NONBLOCK
+*/
+static int
+cmdline_fd_set_nonblock(int fd, int nonblock)
+{
+    int flags;
+
+    flags = fcntl(fd, F_GETFL);
+    if(flags < 0)
+        return -1;
+    if(nonblock)
+        flags |= O_NONBLOCK;
+    else
+        flags &= ~O_NONBLOCK;
+    return fcntl(fd, F_SETFL, flags);
+}
+
+int
+cmdline_set_nonblock(struct cmdline* cl, int nonblock)
+{
+    if(!cl || cl->cmdline_in < 0)
+        return -1;
+
+    if(cmdline_fd_set_nonblock(cl->cmdline_in, nonblock) < 0)
+        return -1;
+    if(cl->cmdline_out >= 0 && cl->cmdline_out != cl->cmdline_in &&
+       cmdline_fd_set_nonblock(cl->cmdline_out, nonblock) < 0)
+        return -1;
+    return 0;
+}
+
+/*
+* 内部函数 根据输出缓冲区是否有剩余 更新epoll关注的事件
+* 输出流单独注册时 EPOLLOUT关注在输出流上
+*/
+static void
+cmdline_epoll_update(struct cmdline* cl)
+{
+    struct epoll_event ev;
+
+    if(cl->epoll_fd < 0)
+        return;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.data.ptr = cl;
+    if(cl->out_epoll)
+    {
+        ev.events = cl->out_len > 0 ? EPOLLOUT : 0;
+        epoll_ctl(cl->epoll_fd, EPOLL_CTL_MOD, cl->cmdline_out, &ev);
+        return;
+    }
+    ev.events = EPOLLIN;
+    if(cl->out_len > 0 && cl->cmdline_out == cl->cmdline_in)
+        ev.events |= EPOLLOUT;
+    epoll_ctl(cl->epoll_fd, EPOLL_CTL_MOD, cl->cmdline_in, &ev);
+}
+
+int
+cmdline_on_readable(struct cmdline* cl)
+{
+    if(!cl)
+        return -1;
+
+    char buf[INPUT_READ_CHUNK_SIZE];
+    ssize_t n;
+    int total = 0;
+
+    while(1)
+    {
+        n = read(cl->cmdline_in, buf, sizeof(buf));
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            //已无内容可读
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return -1;
+        }
+        //输入流关闭
+        if(n == 0)
+            return -1;
+        if(cmdline_parse_input(cl, buf, n) < 0)
+            return -1;
+        total += n;
+        //未读满说明已读完 避免阻塞式输入流在此阻塞
+        if(n < (ssize_t)sizeof(buf))
+            break;
+    }
+    
+    if(cl->out_len > 0)
+        cmdline_epoll_update(cl);
+    return total;
+}
+
+int
+cmdline_on_writable(struct cmdline* cl)
+{
+    if(!cl)
+        return -1;
+
+    int ret;
+
+    ret = cmdline_flush(cl);
+    cmdline_epoll_update(cl);
+    return ret;
+}
+
+int
+cmdline_epoll_register(struct cmdline* cl, int epfd)
+{
+    if(!cl || epfd < 0 || cl->cmdline_in < 0)
+        return -1;
+
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    if(cl->out_len > 0 && cl->cmdline_out == cl->cmdline_in)
+        ev.events |= EPOLLOUT;
+    ev.data.ptr = cl;
+    if(epoll_ctl(epfd, EPOLL_CTL_ADD, cl->cmdline_in, &ev) < 0)
+        return -1;
+
+    //输出流不同时单独注册 有剩余内容时才关注EPOLLOUT
+    //普通文件等不支持epoll的输出流总是可写 无需注册
+    cl->out_epoll = 0;
+    if(cl->cmdline_out >= 0 && cl->cmdline_out != cl->cmdline_in)
+    {
+        ev.events = cl->out_len > 0 ? EPOLLOUT : 0;
+        if(epoll_ctl(epfd, EPOLL_CTL_ADD, cl->cmdline_out, &ev) == 0)
+        {
+            cl->out_epoll = 1;
+        }
+        else if(errno != EPERM)
+        {
+            epoll_ctl(epfd, EPOLL_CTL_DEL, cl->cmdline_in, NULL);
+            return -1;
+        }
+    }
+    cl->epoll_fd = epfd;
+    return 0;
+}
+
+void
+cmdline_epoll_unregister(struct cmdline* cl)
+{
+    if(!cl || cl->epoll_fd < 0)
+        return;
+    epoll_ctl(cl->epoll_fd, EPOLL_CTL_DEL, cl->cmdline_in, NULL);
+    if(cl->out_epoll)
+        epoll_ctl(cl->epoll_fd, EPOLL_CTL_DEL, cl->cmdline_out, NULL);
+    cl->out_epoll = 0;
+    cl->epoll_fd = -1;
+}
+
+int
+cmdline_epoll_handle(struct cmdline* cl, uint32_t events)
+{
+    if(!cl)
+        return -1;
+
+    if(events & EPOLLIN)
+    {
+        if(cmdline_on_readable(cl) < 0)
+            return -1;
+    }
+    //对端关闭且已无内容可读
+    else if(events & (EPOLLHUP | EPOLLERR))
+    {
+        return -1;
+    }
+    if(events & EPOLLOUT)
+        cmdline_on_writable(cl);
+    return 0;
+}
+
 int
 cmdline_parse_input(struct cmdline* cl, const char* buf, unsigned int size)
 {
@@ -181,24 +620,134 @@ cmdline_parse_input(struct cmdline* cl, const char* buf, unsigned int size)
     unsigned int i;
     int ret = -1;
     
-    //按size对字符挨个处理
-    for(i = 0; i < size; ++i)
+    //先按变化后的终端宽度重新显示
+    cmdline_check_winch(cl);
+
+    //按size对字符进行处理 输出在处理结束后统一flush
+    i = 0;
+    while(i < size)
     {
+        //连续的可打印字符批量处理
+        ret = receiver_parse_chars(&cl->cmd_recv, buf + i, size - i);
+        if(ret > 0)
+        {
+            i += ret;
+            continue;
+        }
+
         ret = receiver_parse_char(&cl->cmd_recv, buf[i]);
+        ++i;
         
         if(ret == RECEIVER_RES_PARSED)
         {
             receiver_new_cmdline(&cl->cmd_recv, cl->prompt);
         }
-        else if(ret == RECEIVER_RES_EOF)
-            return -1;
-        else if(ret == RECEIVER_RES_EXITED)
+        else if(ret == RECEIVER_RES_EOF || ret == RECEIVER_RES_EXITED)
+        {
+            cmdline_flush(cl);
             return -1;
+        }
     }
+    cmdline_flush(cl);
     
     return i;
 }
 
+int
+cmdline_flush(struct cmdline* cl)
+{
+    if(!cl)
+        return -1;
+
+    unsigned int done = 0;
+    ssize_t ret;
+
+    //输出流不存在 直接丢弃
+    if(cl->cmdline_out < 0)
+    {
+        cl->out_len = 0;
+        return 0;
+    }
+
+    while(done < cl->out_len)
+    {
+        ret = write(cl->cmdline_out, cl->out_buf + done, cl->out_len - done);
+        if(ret < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            //输出流暂时不可写 保留未写出的内容
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                memmove(cl->out_buf, cl->out_buf + done, cl->out_len - done);
+                cl->out_len -= done;
+                return -1;
+            }
+            cl->out_len = 0;
+            return -1;
+        }
+        done += ret;
+    }
+    cl->out_len = 0;
+    return 0;
+}
+
+int
+cmdline_flush_wait(struct cmdline* cl)
+{
+    if(!cl)
+        return -1;
+
+    struct pollfd pfd;
+
+    pfd.fd = cl->cmdline_out;
+    pfd.events = POLLOUT;
+    while(cmdline_flush(cl) < 0)
+    {
+        //输出流出错 缓冲区已清空
+        if(cl->out_len == 0)
+            return -1;
+        //输出流暂时不可写 等待可写后继续
+        if(poll(&pfd, 1, -1) < 0 && errno != EINTR)
+            return -1;
+    }
+    return 0;
+}
+
+int
+cmdline_printf(struct cmdline* cl, const char* fmt, ...)
+{
+    if(!cl || !fmt)
+        return -1;
+
+    char buf[BUFSIZ];
+    char* str = buf;
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if(len < 0)
+        return -1;
+
+    //内容超出栈上的缓冲区时 按实际长度分配后重新格式化
+    if(len > (int)sizeof(buf) - 1)
+    {
+        str = malloc(len + 1);
+        if(str == NULL)
+            return -1;
+        va_start(ap, fmt);
+        vsnprintf(str, len + 1, fmt, ap);
+        va_end(ap);
+    }
+    
+    len = cmdline_write_buf(cl, str, len);
+    if(str != buf)
+        free(str);
+    return len;
+}
+
 void
 cmdline_quit(struct cmdline* cl)
 {
@@ -213,17 +762,29 @@ cmdline_exit_free(struct cmdline* cl)
     if(!cl)
         return;
     
+    //关闭终端的括号粘贴 输出剩余内容
+    if(cl->cmd_recv.paste_mode != RECEIVER_PASTE_OFF)
+        cmdline_puts(cl, vt102_paste_off);
+    cmdline_flush(cl);
+    cmdline_epoll_unregister(cl);
+
+    //恢复终端设置及SIGWINCH原有的处理方式
+    if(cl->term_saved)
+        tcsetattr(cl->cmdline_in, TCSANOW, &cl->oldterm);
+    if(cl->winch_saved)
+        sigaction(SIGWINCH, &cl->old_winch, NULL);
+
     //关闭输入输出流
     if (cl->cmdline_in > 2)
         close(cl->cmdline_in);
     if (cl->cmdline_out != cl->cmdline_in && cl->cmdline_out > 2)
         close(cl->cmdline_out);
 
-    //free历史记录部分
-    history_free(&cl->cmd_recv.hist);
-
-    //free并且恢复终端设置
-    tcsetattr(fileno(stdin), TCSANOW, &cl->oldterm);
+    //free接收器缓冲区及历史记录部分
+    receiver_free(&cl->cmd_recv);
+    parse_index_free(cl->cmd_index);
+    free(cl->result_buf);
+    free(cl->out_buf);
     free(cl);
 }
 
@@ -35,6 +35,8 @@
 #ifndef _CMDLINE_H_
 #define _CMDLINE_H_
 
+#include<stdint.h>
+#include<signal.h>
 #include<termios.h>
 #include<nice_cmd/receiver.h>
 #include<nice_cmd/parse.h>
@@ -50,6 +52,20 @@ extern "C"
 #define INPUT_STREAM 0
 #define OUTPUT_STREAM 1
 
+/*
+* 输出缓冲区大小
+* 一次按键处理产生的输出先累积在此 处理结束后统一write
+* 缓冲区写满时先尝试输出 输出流暂时不可写时按2倍扩容 直至OUTPUT_BUF_LIMIT
+* 超出OUTPUT_BUF_LIMIT的内容被丢弃
+*/
+#define OUTPUT_BUF_MAX_SIZE 4096
+#define OUTPUT_BUF_LIMIT (1 << 20)
+
+/*
+* 交互时单次从输入流读取的最大长度
+*/
+#define INPUT_READ_CHUNK_SIZE 4096
+
 /*
 * struct cmdline为最外层结构体，
 * 交互式命令行由此结构体配置
@@ -57,6 +73,7 @@ extern "C"
 *
 *      prompt: 命令行提示符
 *   cmd_group: 命令行的命令组
+*   cmd_index: 由命令组编译的命令索引 可与其他cmdline共享
 *    cmd_recv: 命令行的接收器
 *  cmdline_in: 输入流
 *       -- 默认设为标准输入流
@@ -64,37 +81,216 @@ extern "C"
 *       -- 默认设为标准输出流
 *     oldterm: 终端配置备份
 *       -- 退出命令行时恢复终端设置
+*  term_saved: 是否修改过终端设置 为1时oldterm有效
+*   old_winch: SIGWINCH原有的处理方式 退出命令行时恢复
+* winch_saved: 是否设置过SIGWINCH的处理 为1时old_winch有效
+*     out_buf: 输出缓冲区(malloc/按需扩容)
+*     out_len: 输出缓冲区中待输出的长度
+*     out_cap: 输出缓冲区容量
+*    epoll_fd: 注册的外部epoll实例 未注册时为-1
+*   out_epoll: 输出流与输入流不同时 输出流是否单独注册至epoll_fd
+*  result_buf: 解析结果缓冲区 长度为命令组中最大的解析结果长度
+* result_size: 解析结果缓冲区长度
 */
 struct cmdline
 {
     char prompt[PROMPT_MAX_SIZE];
     parse_ctx_t* cmd_group;
+    struct parse_index* cmd_index;
     struct receiver cmd_recv;
     int cmdline_in;
     int cmdline_out;
     struct termios oldterm;
+    int term_saved;
+    struct sigaction old_winch;
+    int winch_saved;
+    char* out_buf;
+    unsigned int out_len;
+    unsigned int out_cap;
+    int epoll_fd;
+    int out_epoll;
+    char* result_buf;
+    unsigned int result_size;
 };
 
 /*
 * 获取新的cmdline 
+* 命令组中存在解析结果长度有误的命令时返回NULL (参照parse_ctx_result_size())
 */
 struct cmdline* cmdline_get_new(parse_ctx_t* ctx, const char* prompt);
 
+/*
+* 在指定输入输出流上获取新的cmdline
+* 不会修改终端设置 用于socket等非终端会话
+*
+*  in: 输入流
+* out: 输出流 可与in相同
+*/
+struct cmdline* cmdline_get_new_fd(parse_ctx_t* ctx, const char* prompt, int in, int out);
+
+/*
+* 使用已编译的命令索引获取新的cmdline 不会修改终端设置
+* 多个cmdline使用同一命令组时可共享索引 避免重复编译
+*
+* idx: parse_index_new()返回的命令索引 cmdline会持有其引用
+*/
+struct cmdline* cmdline_get_new_index(struct parse_index* idx, const char* prompt, int in, int out);
+
 /*
 * 为指定cmdline设置提示符
 */
 void cmdline_set_prompt(struct cmdline* cl, const char* prompt);
 
+/*
+* 为指定cmdline使用历史记录文件 读取文件中的历史记录 之后的命令追加至文件
+*
+* path: 文件路径 不存在时创建
+* sync: 同步策略 HISTORY_SYNC_NONE/HISTORY_SYNC_ALWAYS
+*
+* 返回0为成功 -1为失败
+*/
+int cmdline_set_history_file(struct cmdline* cl, const char* path, int sync);
+
+/*
+* 为指定cmdline设置重复命令的处理方式
+* 需在cmdline_set_history_file()之前设置 读取文件时即进行去重
+*
+* mode: HISTORY_DEDUP_NONE/HISTORY_DEDUP_CONSECUTIVE/HISTORY_DEDUP_ALL
+*
+* 返回0为成功 -1为失败
+*/
+int cmdline_set_history_dedup(struct cmdline* cl, int mode);
+
+/*
+* 为指定cmdline使用共享历史记录 多个cmdline(可位于不同线程)共享时
+* 一个cmdline执行的命令可在其他cmdline中立即查询到
+*
+* shared: history_shared_new()返回的共享历史记录 cmdline会持有其引用
+*
+* 返回0为成功 -1为失败
+*/
+int cmdline_set_history_shared(struct cmdline* cl, struct history_shared* shared);
+
+/*
+* 设置指定cmdline单条命令的长度上限 默认为INPUT_BUF_MAX_SIZE
+* 输入缓冲区按需扩容 超出上限的输入被丢弃 超出上限的命令不记录至历史记录
+* 需在读取历史记录文件之前设置
+*
+* 返回0为成功 -1为失败
+*/
+int cmdline_set_line_max(struct cmdline* cl, unsigned int max);
+
+/*
+* 设置指定cmdline的终端宽度(列数) 超过宽度的命令分多行显示及编辑
+* cmdline_get_new()使用终端时通过TIOCGWINSZ查询 并设置SIGWINCH的处理(SA_RESTART)
+* 收到SIGWINCH后在下一次处理输入前重新查询 cmdline_exit_free()时恢复原有的处理方式
+* socket等会话可由telnet NAWS等方式取得宽度后设置 默认为0 即按不换行处理
+*
+* 返回0为成功 -1为失败
+*/
+int cmdline_set_width(struct cmdline* cl, unsigned int cols);
+
+/*
+* 设置指定cmdline的括号粘贴模式(xterm bracketed paste)
+* 开启时向终端输出ESC[?2004h 粘贴的内容由ESC[200~与ESC[201~包围
+* 粘贴内容一次插入输入缓冲区 不触发补全/执行等按键 结束时只刷新一次显示
+* 关闭时及cmdline_exit_free()时输出ESC[?2004l
+* cmdline_get_new()使用终端时默认为RECEIVER_PASTE_INSERT 其余默认关闭
+*
+* mode: RECEIVER_PASTE_OFF/RECEIVER_PASTE_INSERT/RECEIVER_PASTE_EXEC
+*       RECEIVER_PASTE_EXEC时粘贴内容中的每一行作为命令依次执行
+*
+* 返回0为成功 -1为失败
+*/
+int cmdline_set_bracketed_paste(struct cmdline* cl, int mode);
+
 /*
 * 指定cmdline开始交互
 */
 void cmdline_start_interact(struct cmdline* cl);
 
+/*
+* 获取指定cmdline的输入流 供poll/epoll等待可读事件
+*/
+int cmdline_get_fd(struct cmdline* cl);
+
+/*
+* 设置指定cmdline输入输出流的阻塞模式
+* nonblock为1时设为非阻塞 为0时设为阻塞
+*
+* 返回0为成功 -1为失败
+*/
+int cmdline_set_nonblock(struct cmdline* cl, int nonblock);
+
+/*
+* 输入流可读时调用 读取当前所有可读内容并进行处理
+* 不会阻塞于已无内容可读的输入流 可替代cmdline_start_interact()接入事件循环
+*
+* 返回值为本次处理的字符数
+* 返回-1说明命令行已退出或输入流已关闭 应将其移出事件循环
+*/
+int cmdline_on_readable(struct cmdline* cl);
+
+/*
+* 输出流可写时调用 输出缓冲区中剩余的内容
+* 返回0为输出完毕 -1为仍有内容未输出
+*/
+int cmdline_on_writable(struct cmdline* cl);
+
+/*
+* 将指定cmdline注册至外部epoll实例
+* 事件的data.ptr为cl 输出缓冲区有剩余内容时会自动关注EPOLLOUT
+* 输出流与输入流不同时(如终端的0/1) 输出流单独注册 其事件同样交给cmdline_epoll_handle()
+*
+* 返回0为成功 -1为失败
+*/
+int cmdline_epoll_register(struct cmdline* cl, int epfd);
+
+/*
+* 将指定cmdline移出注册的epoll实例
+*/
+void cmdline_epoll_unregister(struct cmdline* cl);
+
+/*
+* 处理epoll_wait()返回的指定cmdline的事件
+*
+* events: epoll_event.events
+*
+* 返回0为成功 -1说明命令行已退出或连接已断开 应调用cmdline_exit_free()
+*/
+int cmdline_epoll_handle(struct cmdline* cl, uint32_t events);
+
 /*
 * 指定cmdline录入指定内容
 */
 int cmdline_parse_input(struct cmdline* cl, const char* buf, unsigned int size);
 
+/*
+* 将指定cmdline输出缓冲区中的内容写入输出流
+* 命令回调函数中直接向输出流写数据前 应先调用此函数
+*
+* 返回0为成功 -1为失败(未写出的内容仍保留在缓冲区)
+*/
+int cmdline_flush(struct cmdline* cl);
+
+/*
+* 将指定cmdline输出缓冲区中的内容全部写入输出流
+* 非阻塞的输出流暂时不可写时 poll等待至可写 命令回调函数执行前调用
+* 以保证回调函数直接写入输出流的内容位于回显的命令之后
+*
+* 返回0为成功 -1为失败(输出流出错 缓冲区已清空)
+*/
+int cmdline_flush_wait(struct cmdline* cl);
+
+/*
+* 向指定cmdline的输出缓冲区写入格式化内容
+* 内容随本次输入处理结束时一并输出 或通过cmdline_flush()立即输出
+*
+* 返回值为写入的长度
+* 返回-1为失败 或有内容被丢弃(输出流出错/超出OUTPUT_BUF_LIMIT) 输出不完整
+*/
+int cmdline_printf(struct cmdline* cl, const char* fmt, ...);
+
 /*
 * 指定cmdline退出
 */
@@ -0,0 +1,230 @@
+/*************************************************************************
+	> File Name: gapbuf.c
+	> Author: ZHJ
+	> Remarks: 接收器的行编辑缓冲区 使用间隙缓冲区(gap buffer)储存整行输入
+	> Created Time: Sat 17 Oct 2026 08:47:52 PM CST
+ ************************************************************************/
+
+#include<errno.h>
+#include<stdlib.h>
+#include<string.h>
+#include"gapbuf.h"
+
+/*
+* 内部函数 将间隙移动至at处
+* 只移动间隙两侧之间的内容 复杂度为O(|at - gap|)
+*/
+static void
+gapbuf_move_gap(struct gapbuf* gb, unsigned int at)
+{
+    unsigned int gap_len = gb->size - gb->len;
+
+    if(at < gb->gap)
+        memmove(gb->buf + at + gap_len, gb->buf + at, gb->gap - at);
+    else if(at > gb->gap)
+        memmove(gb->buf + gb->gap, gb->buf + gb->gap + gap_len, at - gb->gap);
+    gb->gap = at;
+}
+
+/*
+* 内部函数 扩容至可容纳len个字符(另加2字节间隙)
+* 间隙之后的内容移动至新内存的结尾 间隙位置不变
+* 返回0为成功 -1为失败
+*/
+static int
+gapbuf_reserve(struct gapbuf* gb, unsigned int len)
+{
+    unsigned int size = gb->size ? gb->size : GAPBUF_INIT_SIZE;
+    unsigned int tail = gb->len - gb->gap;
+    char* buf;
+
+    if(len + 2 <= gb->size)
+        return 0;
+    while(size < len + 2)
+        size *= 2;
+    //不超过上限所需的大小
+    if(size > gb->max + 2)
+        size = gb->max + 2;
+
+    buf = realloc(gb->buf, size);
+    if(buf == NULL)
+        return -1;
+    memmove(buf + size - tail, buf + gb->size - tail, tail);
+    gb->buf = buf;
+    gb->size = size;
+    return 0;
+}
+
+int
+gapbuf_init(struct gapbuf* gb, unsigned int max)
+{
+    if(!gb || max == 0)
+        return -EINVAL;
+    gb->buf = NULL;
+    gb->size = 0;
+    gb->len = 0;
+    gb->pos = 0;
+    gb->gap = 0;
+    gb->max = max;
+    return 0;
+}
+
+int
+gapbuf_set_max(struct gapbuf* gb, unsigned int max)
+{
+    if(!gb || max == 0 || max < gb->len)
+        return -EINVAL;
+    gb->max = max;
+    return 0;
+}
+
+void
+gapbuf_clear(struct gapbuf* gb)
+{
+    if(!gb)
+        return;
+    gb->len = 0;
+    gb->pos = 0;
+    gb->gap = 0;
+}
+
+void
+gapbuf_free(struct gapbuf* gb)
+{
+    if(!gb)
+        return;
+    free(gb->buf);
+    gb->buf = NULL;
+    gb->size = 0;
+    gapbuf_clear(gb);
+}
+
+void
+gapbuf_set_pos(struct gapbuf* gb, unsigned int pos)
+{
+    if(!gb)
+        return;
+    gb->pos = pos < gb->len ? pos : gb->len;
+}
+
+unsigned int
+gapbuf_insert(struct gapbuf* gb, const char* str, unsigned int size)
+{
+    if(!gb || !str)
+        return 0;
+
+    //超出上限的部分被丢弃 扩容失败时仅使用已有空间
+    if(size > gb->max - gb->len)
+        size = gb->max - gb->len;
+    if(size == 0)
+        return 0;
+    if(gapbuf_reserve(gb, gb->len + size) < 0)
+    {
+        //保留2字节间隙
+        if(gb->size < gb->len + 2)
+            return 0;
+        if(size > gb->size - 2 - gb->len)
+            size = gb->size - 2 - gb->len;
+        if(size == 0)
+            return 0;
+    }
+
+    gapbuf_move_gap(gb, gb->pos);
+    memcpy(gb->buf + gb->gap, str, size);
+    gb->gap += size;
+    gb->len += size;
+    gb->pos += size;
+    return size;
+}
+
+unsigned int
+gapbuf_del_left(struct gapbuf* gb, unsigned int n)
+{
+    if(!gb)
+        return 0;
+    if(n > gb->pos)
+        n = gb->pos;
+    if(n == 0)
+        return 0;
+
+    //间隙向左扩大
+    gapbuf_move_gap(gb, gb->pos);
+    gb->gap -= n;
+    gb->len -= n;
+    gb->pos -= n;
+    return n;
+}
+
+unsigned int
+gapbuf_del_right(struct gapbuf* gb, unsigned int n)
+{
+    if(!gb)
+        return 0;
+    if(n > gb->len - gb->pos)
+        n = gb->len - gb->pos;
+    if(n == 0)
+        return 0;
+
+    //间隙向右扩大
+    gapbuf_move_gap(gb, gb->pos);
+    gb->len -= n;
+    return n;
+}
+
+unsigned int
+gapbuf_copy(struct gapbuf* gb, unsigned int from, unsigned int n, char* dst)
+{
+    if(!gb || !dst || from >= gb->len)
+        return 0;
+
+    unsigned int first = 0;
+
+    if(n > gb->len - from)
+        n = gb->len - from;
+
+    //间隙之前的部分
+    if(from < gb->gap)
+    {
+        first = gb->gap - from < n ? gb->gap - from : n;
+        memcpy(dst, gb->buf + from, first);
+    }
+    //间隙之后的部分
+    if(first < n)
+        memcpy(dst + first, gb->buf + from + first + gb->size - gb->len, n - first);
+    return n;
+}
+
+const char*
+gapbuf_line(struct gapbuf* gb, int eol)
+{
+    if(!gb)
+        return NULL;
+    //尚未分配内存
+    if(gb->buf == NULL && gapbuf_reserve(gb, 0) < 0)
+        return eol ? "\n" : "";
+
+    gapbuf_move_gap(gb, gb->len);
+    if(eol)
+    {
+        gb->buf[gb->len] = '\n';
+        gb->buf[gb->len + 1] = '\0';
+    }
+    else
+    {
+        gb->buf[gb->len] = '\0';
+    }
+    return gb->buf;
+}
+
+const char*
+gapbuf_left(struct gapbuf* gb)
+{
+    if(!gb)
+        return NULL;
+    if(gb->buf == NULL && gapbuf_reserve(gb, 0) < 0)
+        return "";
+
+    gapbuf_move_gap(gb, gb->pos);
+    gb->buf[gb->pos] = '\0';
+    return gb->buf;
+}
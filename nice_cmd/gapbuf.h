@@ -0,0 +1,138 @@
+/*************************************************************************
+	> File Name: gapbuf.h
+	> Author: ZHJ
+	> Remarks: 接收器的行编辑缓冲区 使用间隙缓冲区(gap buffer)储存整行输入
+	> Created Time: Sat 17 Oct 2026 08:31:06 PM CST
+ ************************************************************************/
+
+#ifndef _GAPBUF_H_
+#define _GAPBUF_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+* 缓冲区首次分配的大小 之后按2倍扩容
+*/
+#define GAPBUF_INIT_SIZE 64
+
+/*
+* 间隙缓冲区
+* 内容为buf[0, gap)与buf[gap + size - len, size)两段 中间为间隙
+* 光标位置pos与间隙位置gap相互独立 移动光标的复杂度为O(1)
+* 在光标处编辑时才将间隙移动至光标处 只需一次memmove
+* 间隙至少保留2字节 用于在不copy的情况下输出以'\0'结尾的内容
+* 内存在第一次插入时分配 空间不足时扩容 内容长度不超过max
+*
+*  buf: 缓冲区内存指针(malloc/需free) 未分配时为NULL
+* size: 缓冲区内存大小 内容最长为size - 2
+*  len: 内容长度
+*  pos: 光标位置 即光标左侧的字符数
+*  gap: 间隙起点
+*  max: 内容长度上限
+*/
+struct gapbuf
+{
+    char* buf;
+    unsigned int size;
+    unsigned int len;
+    unsigned int pos;
+    unsigned int gap;
+    unsigned int max;
+};
+
+/*
+* 返回值为1时 缓冲区为空
+*/
+#define GAPBUF_IS_EMPTY(gb) ((gb)->len == 0)
+
+/*
+* 光标左侧/右侧的字符数
+*/
+#define GAPBUF_LEFT_LEN(gb) ((gb)->pos)
+#define GAPBUF_RIGHT_LEN(gb) ((gb)->len - (gb)->pos)
+
+/*
+* 内容中第i个字符
+*/
+#define GAPBUF_AT(gb, i) \
+    ((gb)->buf[(i) < (gb)->gap ? (i) : (i) + (gb)->size - (gb)->len])
+
+/*
+* for each遍历宏 从第from个字符遍历至结尾 不移动间隙
+* gb: struct gapbuf 指针
+*  i: 用于for遍历的整形变量
+*  c: 储存每次迭代的字符
+*/
+#define GAPBUF_FOREACH(gb, from, i, c) \
+    for(i = (from); i < (gb)->len && ((c) = GAPBUF_AT(gb, i), 1); ++i)
+
+/*
+* 缓冲区初始化函数 不分配内存
+* max: 内容长度上限 至少为1
+* 返回0为成功
+*/
+int gapbuf_init(struct gapbuf* gb, unsigned int max);
+
+/*
+* 修改内容长度上限 小于当前内容长度时失败
+* 已分配的内存不会缩小
+* 返回0为成功
+*/
+int gapbuf_set_max(struct gapbuf* gb, unsigned int max);
+
+/*
+* 清空缓冲区 保留已分配的内存
+*/
+void gapbuf_clear(struct gapbuf* gb);
+
+/*
+* 释放缓冲区内存 之后可继续使用
+*/
+void gapbuf_free(struct gapbuf* gb);
+
+/*
+* 移动光标至pos 超出内容长度时移动至结尾
+*/
+void gapbuf_set_pos(struct gapbuf* gb, unsigned int pos);
+
+/*
+* 在光标处插入size个字符 光标移动至插入内容之后
+* 空间不足时扩容 超出长度上限或扩容失败时仅插入能容纳的部分
+* 返回值为实际插入的字符数
+*/
+unsigned int gapbuf_insert(struct gapbuf* gb, const char* str, unsigned int size);
+
+/*
+* 删除光标左侧/右侧的n个字符
+* 返回值为实际删除的字符数
+*/
+unsigned int gapbuf_del_left(struct gapbuf* gb, unsigned int n);
+unsigned int gapbuf_del_right(struct gapbuf* gb, unsigned int n);
+
+/*
+* 将从第from个字符开始的n个字符copy至dst 最多分两段memcpy
+* 返回值为实际copy的字符数
+*/
+unsigned int gapbuf_copy(struct gapbuf* gb, unsigned int from, unsigned int n, char* dst);
+
+/*
+* 获取连续的完整内容 将间隙移动至结尾 不进行copy
+* eol为1时内容后为"\n\0" 否则为"\0" 结尾字符写在间隙中 不计入内容
+* 返回值在下一次编辑前有效
+*/
+const char* gapbuf_line(struct gapbuf* gb, int eol);
+
+/*
+* 获取光标左侧的内容 以'\0'结尾 将间隙移动至光标处
+* 返回值在下一次编辑前有效
+*/
+const char* gapbuf_left(struct gapbuf* gb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
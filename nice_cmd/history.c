@@ -5,41 +5,511 @@
 	> Created Time: Sat 08 Jan 2022 04:42:13 PM CST
  ************************************************************************/
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include<stdio.h>
 #include<stdlib.h>
 #include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/file.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<sys/uio.h>
 #include"history.h"
 
-history_cmd_t* 
-new_command(char* cmd, int len, int max_size)
+/*
+* static 序号为idx的命令在entries中的位置
+*/
+static struct history_entry*
+history_entry(struct history* hist, int idx)
 {
-    if(len > max_size)
-        return NULL;
+    unsigned int pos = hist->entry_first + idx;
 
-    history_cmd_t* ret;
-    char* temp_ptr; 
-    
-    ret = (history_cmd_t*)malloc(sizeof(history_cmd_t));
-    temp_ptr = (char*)malloc(sizeof(char) * (len + 1));
-    
-    strncpy(temp_ptr, cmd, len);
-    temp_ptr[len] = '\0';
+    if(pos >= hist->entry_cap)
+        pos -= hist->entry_cap;
+    return &hist->entries[pos];
+}
 
-    ret->cmd = temp_ptr;
-    ret->len = len;
-    ret->prev = NULL;
-    ret->next = NULL;
-    return ret;
+/*
+* static 二分查找全局序号为seq的命令
+* 返回值为命令序号 -1为已删除
+*/
+static int
+history_seq_find(struct history* hist, uint32_t seq)
+{
+    int lo = 0, hi = hist->history_cmd_num, mid;
+    uint32_t cur;
+
+    while(lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        cur = history_entry(hist, mid)->seq;
+        if(cur == seq)
+            return mid;
+        if(cur < seq)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return -1;
 }
 
-void 
-delete_command(history_cmd_t* command)
+/*
+* static 按时间顺序将所有命令重新排列至新的缓冲区 用于扩容及整理空位
+* 
+* entry_cap: 新的命令缓冲区容量
+*   str_cap: 新的字符串缓冲区容量
+*
+* 返回0为成功 -1为失败
+*/
+static int
+history_resize(struct history* hist, unsigned int entry_cap, unsigned int str_cap)
+{
+    struct history_entry* entries;
+    struct history_entry* e;
+    char* strs;
+    unsigned int off = 0;
+    int i, n = 0;
+
+    entries = malloc(entry_cap * sizeof(struct history_entry));
+    strs = malloc(str_cap);
+    if(entries == NULL || strs == NULL)
+    {
+        free(entries);
+        free(strs);
+        return -1;
+    }
+
+    //跳过空位 当前历史命令的序号随之前移
+    for(i = 0; i < hist->history_cmd_num; ++i)
+    {
+        e = history_entry(hist, i);
+        if(e->len & HISTORY_ENTRY_DEAD)
+            continue;
+        if(hist->now == i)
+            hist->now = n;
+        memcpy(strs + off, hist->strs + e->off, e->len + 1);
+        entries[n].off = off;
+        entries[n].len = e->len;
+        entries[n].seq = e->seq;
+        off += e->len + 1;
+        ++n;
+    }
+
+    free(hist->entries);
+    free(hist->strs);
+    hist->entries = entries;
+    hist->entry_cap = entry_cap;
+    hist->entry_first = 0;
+    hist->strs = strs;
+    hist->str_cap = str_cap;
+    hist->str_head = 0;
+    hist->str_tail = off;
+    hist->str_holes = 0;
+    hist->history_cmd_num = n;
+    hist->history_dead_num = 0;
+    return 0;
+}
+
+/*
+* static 在字符串缓冲区中为长度need的字符串寻找位置
+* 字符串需连续储存 尾部空间不足时从头开始
+* 
+* 返回值为写入位置 -1为空间不足
+*/
+static int
+history_str_alloc(struct history* hist, unsigned int need)
+{
+    //没有命令 从头开始
+    if(hist->history_cmd_num == 0)
+    {
+        hist->str_head = 0;
+        hist->str_tail = 0;
+        return need <= hist->str_cap ? 0 : -1;
+    }
+    //未回绕: 尾部 -> 头部之前
+    if(hist->str_tail > hist->str_head)
+    {
+        if(need <= hist->str_cap - hist->str_tail)
+            return hist->str_tail;
+        if(need < hist->str_head)
+            return 0;
+        return -1;
+    }
+    //已回绕: 尾部与头部之间
+    if(need < hist->str_head - hist->str_tail)
+        return hist->str_tail;
+    return -1;
+}
+
+/*
+* static 有最大历史记录数时字符串缓冲区的扩容上限
+* 单条命令较长时 没有命令也放不下的情况下仍会扩容
+*/
+static unsigned int
+history_str_limit(struct history* hist)
+{
+    unsigned long limit = (unsigned long)hist->entry_cap * (hist->command_buf_max_size + 1);
+
+    return limit <= HISTORY_STR_FULL_SIZE ? (unsigned int)limit : HISTORY_STR_FULL_SIZE;
+}
+
+/*
+* static 三元组的键值
+*/
+static uint32_t
+trigram_key(const char* s)
+{
+    return (((uint32_t)(uint8_t)s[0] << 16) | ((uint32_t)(uint8_t)s[1] << 8) | (uint8_t)s[2]) + 1;
+}
+
+/*
+* static 命令开头n(1~3)个字符的键值 高8位为n 与三元组的键值不重叠
+*/
+static uint32_t
+prefix_key(const char* s, unsigned int n)
+{
+    uint32_t key = (uint32_t)n << 24;
+    unsigned int i;
+
+    for(i = 0; i < n; ++i)
+        key |= (uint32_t)(uint8_t)s[i] << (16 - 8 * i);
+    return key + 1;
+}
+
+/*
+* static 查找三元组对应的槽位
+* 不存在时返回空槽位(key为0)
+*/
+static struct history_posting*
+history_index_slot(struct history_index* index, uint32_t key)
+{
+    uint32_t mask = index->nb_slots - 1;
+    uint32_t i = (key * 2654435761u) & mask;
+
+    while(index->slots[i].key != 0 && index->slots[i].key != key)
+        i = (i + 1) & mask;
+    return &index->slots[i];
+}
+
+/*
+* static 哈希表扩容为原来的两倍
+* 返回0为成功 -1为失败
+*/
+static int
+history_index_grow(struct history_index* index)
+{
+    struct history_posting* old = index->slots;
+    uint32_t nb_old = index->nb_slots, i;
+
+    index->slots = calloc(nb_old * 2, sizeof(struct history_posting));
+    if(index->slots == NULL)
+    {
+        index->slots = old;
+        return -1;
+    }
+    index->nb_slots = nb_old * 2;
+    for(i = 0; i < nb_old; ++i)
+    {
+        if(old[i].key != 0)
+            *history_index_slot(index, old[i].key) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+/*
+* static 将序号seq加入键值key对应的列表
+* 同时移除列表头部已删除命令的序号
+*
+* 返回0为成功 -1为失败
+*/
+static int
+history_posting_add(struct history* hist, uint32_t key, uint32_t seq)
+{
+    struct history_index* index = hist->index;
+    struct history_posting* p;
+    uint32_t* seqs;
+
+    //负载超过3/4时扩容
+    if((index->nb_used + 1) * 4 > index->nb_slots * 3 && history_index_grow(index) < 0)
+        return -1;
+    p = history_index_slot(index, key);
+    if(p->key == 0)
+    {
+        p->key = key;
+        ++index->nb_used;
+    }
+    //同一命令中重复的三元组只记录一次
+    if(p->len > p->start && p->seqs[p->len - 1] == seq)
+        return 0;
+
+    //移除已删除的命令 超过一半时整体前移
+    while(p->start < p->len && p->seqs[p->start] < history_entry(hist, 0)->seq)
+        ++p->start;
+    if(p->start > 0 && p->start * 2 >= p->len)
+    {
+        memmove(p->seqs, p->seqs + p->start, (p->len - p->start) * sizeof(uint32_t));
+        p->len -= p->start;
+        p->start = 0;
+    }
+
+    if(p->len == p->cap)
+    {
+        seqs = realloc(p->seqs, (p->cap ? p->cap * 2 : 4) * sizeof(uint32_t));
+        if(seqs == NULL)
+            return -1;
+        p->seqs = seqs;
+        p->cap = p->cap ? p->cap * 2 : 4;
+    }
+    p->seqs[p->len++] = seq;
+    return 0;
+}
+
+/*
+* static 将序号为seq的命令加入索引
+* 记录命令中的所有三元组 及命令开头的1~3个字符
+*
+* 返回0为成功 -1为失败
+*/
+static int
+history_index_add(struct history* hist, uint32_t seq, const char* cmd, unsigned int len)
+{
+    unsigned int i;
+
+    for(i = 0; i + 3 <= len; ++i)
+    {
+        if(history_posting_add(hist, trigram_key(cmd + i), seq) < 0)
+            return -1;
+    }
+    for(i = 1; i <= 3 && i <= len; ++i)
+    {
+        if(history_posting_add(hist, prefix_key(cmd, i), seq) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+* static free三元组索引
+*/
+static void
+history_index_free(struct history* hist)
 {
-    if(command == NULL)
+    uint32_t i;
+
+    if(hist->index == NULL)
         return;
-    if(command->cmd != NULL)
-        free(command->cmd);
-    free(command);
+    for(i = 0; i < hist->index->nb_slots; ++i)
+        free(hist->index->slots[i].seqs);
+    free(hist->index->slots);
+    free(hist->index);
+    hist->index = NULL;
+}
+
+/*
+* static 由当前所有历史命令建立三元组索引
+* 返回0为成功 -1为失败
+*/
+static int
+history_index_build(struct history* hist)
+{
+    struct history_entry* e;
+    int i;
+
+    hist->index = malloc(sizeof(struct history_index));
+    if(hist->index == NULL)
+        return -1;
+    hist->index->nb_slots = HISTORY_INDEX_INIT_SLOTS;
+    hist->index->nb_used = 0;
+    hist->index->slots = calloc(HISTORY_INDEX_INIT_SLOTS, sizeof(struct history_posting));
+    if(hist->index->slots == NULL)
+    {
+        free(hist->index);
+        hist->index = NULL;
+        return -1;
+    }
+
+    for(i = 0; i < hist->history_cmd_num; ++i)
+    {
+        e = history_entry(hist, i);
+        if(e->len & HISTORY_ENTRY_DEAD)
+            continue;
+        if(history_index_add(hist, e->seq, hist->strs + e->off, e->len) < 0)
+        {
+            history_index_free(hist);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+* static 命令字符串的哈希值(FNV-1a)
+*/
+static uint32_t
+history_hash(const char* cmd, unsigned int len)
+{
+    uint32_t hash = 2166136261u;
+    unsigned int i;
+
+    for(i = 0; i < len; ++i)
+    {
+        hash ^= (uint8_t)cmd[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*
+* static 在去重哈希表中查找与cmd相同的命令
+* 返回值为命令序号 -1为不存在
+*/
+static int
+history_dedup_find(struct history* hist, uint32_t hash, const char* cmd, unsigned int len)
+{
+    struct history_dedup_slot* slot;
+    struct history_entry* e;
+    uint32_t mask = hist->dedup_nb_slots - 1;
+    uint32_t i;
+    int idx;
+
+    for(i = hash & mask; (slot = &hist->dedup_slots[i])->seq != 0; i = (i + 1) & mask)
+    {
+        if(slot->hash != hash || (idx = history_seq_find(hist, slot->seq)) < 0)
+            continue;
+        e = history_entry(hist, idx);
+        if(e->len == len && !memcmp(hist->strs + e->off, cmd, len))
+            return idx;
+    }
+    return -1;
+}
+
+/*
+* static 去重哈希表扩容至nb_slots个槽位
+* 返回0为成功 -1为失败
+*/
+static int
+history_dedup_rehash(struct history* hist, uint32_t nb_slots)
+{
+    struct history_dedup_slot* old = hist->dedup_slots;
+    uint32_t nb_old = hist->dedup_nb_slots, i, j;
+
+    hist->dedup_slots = calloc(nb_slots, sizeof(struct history_dedup_slot));
+    if(hist->dedup_slots == NULL)
+    {
+        hist->dedup_slots = old;
+        return -1;
+    }
+    hist->dedup_nb_slots = nb_slots;
+    for(i = 0; i < nb_old; ++i)
+    {
+        if(old[i].seq == 0)
+            continue;
+        for(j = old[i].hash & (nb_slots - 1); hist->dedup_slots[j].seq != 0; j = (j + 1) & (nb_slots - 1))
+            ;
+        hist->dedup_slots[j] = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+/*
+* static 将命令加入去重哈希表 命令需已加入entries
+* 负载超过1/2时扩容 扩容失败时仍有空槽位即可继续使用
+*/
+static void
+history_dedup_add(struct history* hist, uint32_t hash, uint32_t seq)
+{
+    uint32_t mask, i;
+
+    if((uint32_t)hist->history_cmd_num * 2 > hist->dedup_nb_slots &&
+       history_dedup_rehash(hist, hist->dedup_nb_slots * 2) < 0 &&
+       (uint32_t)hist->history_cmd_num >= hist->dedup_nb_slots)
+        return;
+
+    mask = hist->dedup_nb_slots - 1;
+    for(i = hash & mask; hist->dedup_slots[i].seq != 0; i = (i + 1) & mask)
+        ;
+    hist->dedup_slots[i].hash = hash;
+    hist->dedup_slots[i].seq = seq;
+}
+
+/*
+* static 将序号为idx的命令移出去重哈希表
+* 之后的槽位前移填补 保证线性探测不中断
+*/
+static void
+history_dedup_del(struct history* hist, int idx)
+{
+    struct history_entry* e = history_entry(hist, idx);
+    uint32_t mask = hist->dedup_nb_slots - 1;
+    uint32_t i, j, home;
+
+    for(i = history_hash(hist->strs + e->off, e->len) & mask; hist->dedup_slots[i].seq != e->seq; i = (i + 1) & mask)
+    {
+        if(hist->dedup_slots[i].seq == 0)
+            return;
+    }
+
+    for(j = (i + 1) & mask; hist->dedup_slots[j].seq != 0; j = (j + 1) & mask)
+    {
+        //槽位j的初始位置不在(i, j]之间时 可移动至i
+        home = hist->dedup_slots[j].hash & mask;
+        if(i <= j ? (home <= i || home > j) : (home <= i && home > j))
+        {
+            hist->dedup_slots[i] = hist->dedup_slots[j];
+            i = j;
+        }
+    }
+    hist->dedup_slots[i].seq = 0;
+}
+
+/*
+* static 删除序号为idx的命令 之后的命令序号不变
+* 最久/最新的命令直接回收 其余标记为空位
+* 空位的字符串在其之前的命令被删除后回收 或在整理时回收
+*/
+static void
+history_remove(struct history* hist, int idx)
+{
+    struct history_entry* e;
+
+    if(idx == 0)
+    {
+        history_del_head(hist);
+        return;
+    }
+
+    if(hist->dedup_slots)
+        history_dedup_del(hist, idx);
+    if(hist->now == idx)
+        hist->now = -1;
+
+    //最新的命令 连同之前相邻的空位一起回收
+    if(idx == hist->history_cmd_num - 1)
+    {
+        do
+        {
+            e = history_entry(hist, --hist->history_cmd_num);
+            if(e->len & HISTORY_ENTRY_DEAD)
+            {
+                e->len &= ~HISTORY_ENTRY_DEAD;
+                hist->str_holes -= e->len + 1;
+                --hist->history_dead_num;
+            }
+            hist->str_tail = e->off;
+        }while(history_entry(hist, hist->history_cmd_num - 1)->len & HISTORY_ENTRY_DEAD);
+        return;
+    }
+
+    e = history_entry(hist, idx);
+    hist->str_holes += e->len + 1;
+    e->len |= HISTORY_ENTRY_DEAD;
+    ++hist->history_dead_num;
 }
 
 void 
@@ -48,63 +518,319 @@ history_init(struct history* hist, int max_num, int max_size)
     if(!hist)
         return;
     
-    hist->head = new_command("head-node", 9, max_size);
-    hist->now = NULL;
-    hist->history_cmd_num = 0;
+    unsigned int entry_cap, str_cap;
+
+    memset(hist, 0, sizeof(struct history));
+    hist->now = -1;
     hist->history_cmd_max_num = max_num;
     hist->command_buf_max_size = max_size;
-    hist->user_input_buf = (char*)malloc(sizeof(char) * (max_size + 1));
-    hist->user_input_buf[0] = '\0';
+    //用户输入缓冲区按需扩容
+    hist->user_input_buf_cap = max_size < HISTORY_AVG_CMD_SIZE ? max_size + 1 : HISTORY_AVG_CMD_SIZE + 1;
+    hist->user_input_buf = (char*)malloc(sizeof(char) * hist->user_input_buf_cap);
+    if(hist->user_input_buf)
+        hist->user_input_buf[0] = '\0';
+    else
+        hist->user_input_buf_cap = 0;
     hist->user_input_buf_len = 0;
+    hist->file_fd = -1;
+    hist->file_sync = HISTORY_SYNC_NONE;
+    hist->seq_next = 1;
+
+    //不记录
+    if(max_num < 0)
+        return;
+    
+    //命令缓冲区一次分配(无限制时按倍数扩容)
+    //字符串缓冲区按平均长度分配 之后按倍数扩容至上限(参照history_str_limit())
+    entry_cap = max_num > 0 ? (unsigned int)max_num : HISTORY_INIT_NUM;
+    str_cap = entry_cap * (max_size < HISTORY_AVG_CMD_SIZE ? max_size + 1 : HISTORY_AVG_CMD_SIZE);
+    history_resize(hist, entry_cap, str_cap);
 }
 
-int 
-history_add_new(struct history* hist, char* cmd, int len, int mode)
+void
+history_set_max_size(struct history* hist, int max_size)
 {
-    if(!hist || !cmd || hist->history_cmd_max_num < 0)
+    if(!hist || max_size < 0)
+        return;
+    hist->command_buf_max_size = max_size;
+}
+
+int
+history_set_dedup(struct history* hist, int mode)
+{
+    if(!hist || mode < HISTORY_DEDUP_NONE || mode > HISTORY_DEDUP_ALL)
         return -1;
-    if(hist->head == NULL)
+
+    struct history_entry* e;
+    uint32_t nb_slots, hash;
+    unsigned int entry_cap;
+    int i, idx, num;
+
+    free(hist->dedup_slots);
+    hist->dedup_slots = NULL;
+    hist->dedup_nb_slots = 0;
+    hist->dedup = mode;
+    if(mode != HISTORY_DEDUP_ALL || hist->entries == NULL)
+        return 0;
+
+    //为空位预留命令缓冲区容量
+    entry_cap = hist->history_cmd_max_num + hist->history_cmd_max_num / 2 + 1;
+    if(hist->history_cmd_max_num > 0 && hist->entry_cap < entry_cap &&
+       history_resize(hist, entry_cap, hist->str_cap) < 0)
+    {
+        hist->dedup = HISTORY_DEDUP_NONE;
+        return -1;
+    }
+
+    for(nb_slots = 16; nb_slots < hist->entry_cap * 2; nb_slots *= 2)
+        ;
+    hist->dedup_slots = calloc(nb_slots, sizeof(struct history_dedup_slot));
+    if(hist->dedup_slots == NULL)
+    {
+        hist->dedup = HISTORY_DEDUP_NONE;
         return -1;
+    }
+    hist->dedup_nb_slots = nb_slots;
 
-    history_cmd_t* temp_ptr;
-    history_cmd_t* old_ptr;
+    //已有的重复命令只保留最新的一条
+    for(i = 0; i < hist->history_cmd_num; ++i)
+    {
+        e = history_entry(hist, i);
+        if(e->len & HISTORY_ENTRY_DEAD)
+            continue;
+        hash = history_hash(hist->strs + e->off, e->len);
+        if((idx = history_dedup_find(hist, hash, hist->strs + e->off, e->len)) >= 0)
+        {
+            //删除最久的命令时之后的命令序号前移
+            num = hist->history_cmd_num;
+            history_remove(hist, idx);
+            i -= num - hist->history_cmd_num;
+            e = history_entry(hist, i);
+        }
+        history_dedup_add(hist, hash, e->seq);
+    }
+    return 0;
+}
 
-    //获取新节点
-    temp_ptr = new_command(cmd, len, hist->command_buf_max_size);
-    if(temp_ptr == NULL)
+/*
+* static 将命令添加至环形缓冲区尾部
+* 超出最大历史记录数或字符串空间不足时删除最久的命令
+* 无限制时空间不足则扩容
+* 去重时与已有命令相同 则删除已有的命令后添加
+* 命令缓冲区已满时整理空位 字符串的空位较多时先整理再删除最久的命令
+*
+* 返回0为成功 1为与最新的命令重复而未添加 -1为失败
+*/
+static int
+history_insert(struct history* hist, const char* cmd, int len)
+{
+    struct history_entry* e;
+    uint32_t hash = 0;
+    unsigned int entry_cap;
+    int off, idx;
+
+    if(len < 0 || len > hist->command_buf_max_size || hist->entries == NULL)
         return -1;
+
+    //与最新的命令相同
+    if(hist->dedup != HISTORY_DEDUP_NONE && hist->history_cmd_num > 0)
+    {
+        e = history_entry(hist, hist->history_cmd_num - 1);
+        if(e->len == (unsigned int)len && !memcmp(hist->strs + e->off, cmd, len))
+            return 1;
+    }
+    //与更早的命令相同 先将其删除
+    if(hist->dedup_slots)
+    {
+        hash = history_hash(cmd, len);
+        if((idx = history_dedup_find(hist, hash, cmd, len)) >= 0)
+            history_remove(hist, idx);
+    }
     
-    //插入链表
-    if(hist->history_cmd_num == 0)//第一条
+    //命令数超限
+    if(hist->history_cmd_max_num > 0 &&
+       hist->history_cmd_num - hist->history_dead_num >= hist->history_cmd_max_num)
+        history_del_head(hist);
+
+    //命令缓冲区已满 整理空位 无限制且空位较少时扩容
+    if(hist->history_cmd_num == (int)hist->entry_cap)
     {
-        ++hist->history_cmd_num;
-        hist->head->next = temp_ptr;
-        hist->head->prev = temp_ptr;
-        temp_ptr->next = hist->head;
-        temp_ptr->prev = hist->head;
+        entry_cap = hist->entry_cap;
+        if(hist->history_cmd_max_num == 0 && hist->history_dead_num < (int)entry_cap / 4)
+            entry_cap *= 2;
+        if(history_resize(hist, entry_cap, hist->str_cap) < 0)
+        {
+            if(hist->history_cmd_max_num == 0)
+                return -1;
+            history_del_head(hist);
+        }
     }
-    else//非第一条
+
+    //字符串空间不足 达到上限后整理空位或删除最久的命令
+    while((off = history_str_alloc(hist, len + 1)) < 0)
     {
-        ++hist->history_cmd_num;
-        old_ptr = hist->head->prev;
-        old_ptr->next = temp_ptr;
-        temp_ptr->prev = old_ptr;
-        temp_ptr->next = hist->head;
-        hist->head->prev = temp_ptr;
+        if(hist->history_cmd_max_num > 0 && hist->history_cmd_num > 0 &&
+           hist->str_cap >= history_str_limit(hist))
+        {
+            if(hist->str_holes < hist->str_cap / 4 ||
+               history_resize(hist, hist->entry_cap, hist->str_cap) < 0)
+                history_del_head(hist);
+        }
+        else if(history_resize(hist, hist->entry_cap, hist->str_cap * 2) < 0)
+            return -1;
     }
 
-    if(mode == 0)
+    memcpy(hist->strs + off, cmd, len);
+    hist->strs[off + len] = '\0';
+    hist->str_tail = off + len + 1;
+
+    ++hist->history_cmd_num;
+    e = history_entry(hist, hist->history_cmd_num - 1);
+    e->off = off;
+    e->len = len;
+    e->seq = hist->seq_next++;
+
+    if(hist->dedup_slots)
+        history_dedup_add(hist, hash, e->seq);
+
+    //更新索引 失败时丢弃索引 下次查找时重建
+    if(hist->index && history_index_add(hist, e->seq, cmd, len) < 0)
+        history_index_free(hist);
+
+    return 0;
+}
+
+/*
+* static 锁定历史记录文件
+* 文件已被其他进程重写(rename)时 重新打开file_path后再锁定
+*
+* op: LOCK_SH为追加命令 LOCK_EX为重写文件
+*
+* 返回0为成功 -1为失败
+*/
+static int
+history_file_lock(struct history* hist, int op)
+{
+    struct stat st_fd, st_path;
+    int fd;
+
+    for(;;)
     {
-        hist->now = NULL;
+        while(flock(hist->file_fd, op) < 0)
+        {
+            if(errno != EINTR)
+                return -1;
+        }
+        if(fstat(hist->file_fd, &st_fd) < 0)
+        {
+            flock(hist->file_fd, LOCK_UN);
+            return -1;
+        }
+        if(stat(hist->file_path, &st_path) == 0 &&
+           st_path.st_dev == st_fd.st_dev && st_path.st_ino == st_fd.st_ino)
+            return 0;
+
+        //已打开的文件被替换 之后的写入将丢失
+        flock(hist->file_fd, LOCK_UN);
+        fd = open(hist->file_path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        if(fd < 0)
+            return -1;
+        close(hist->file_fd);
+        hist->file_fd = fd;
     }
-    
-    //如果储存命令数量超限-删除head->next
-    if(hist->history_cmd_max_num > 0 && 
-       hist->history_cmd_num > hist->history_cmd_max_num)
+}
+
+/*
+* static 将命令追加至历史记录文件
+* 命令与换行符通过一次writev写入 O_APPEND保证写入位置为文件末尾
+* 写入期间持有共享锁 不与重写同时进行
+*/
+static int
+history_append_file(struct history* hist, const char* cmd, int len)
+{
+    struct iovec iov[2];
+    ssize_t ret;
+
+    if(history_file_lock(hist, LOCK_SH) < 0)
+        return -1;
+    iov[0].iov_base = (void*)cmd;
+    iov[0].iov_len = len;
+    iov[1].iov_base = "\n";
+    iov[1].iov_len = 1;
+    do
     {
-        history_del_head(hist);
+        ret = writev(hist->file_fd, iov, 2);
+    }while(ret < 0 && errno == EINTR);
+    if(ret == len + 1 && hist->file_sync == HISTORY_SYNC_ALWAYS)
+        fdatasync(hist->file_fd);
+    flock(hist->file_fd, LOCK_UN);
+    if(ret != len + 1)
+        return -1;
+
+    //文件中的命令过多时重写
+    ++hist->file_num;
+    if(hist->history_cmd_max_num > 0 &&
+       hist->file_num > hist->history_cmd_max_num * HISTORY_COMPACT_FACTOR)
+        return history_compact_file(hist);
+    return 0;
+}
+
+/*
+* static 共享历史记录中位置pos对应的槽位
+*/
+static struct history_shared_slot*
+history_shared_slot(struct history_shared* shared, uint64_t pos)
+{
+    return (struct history_shared_slot*)(shared->slots + (size_t)(pos & (shared->cap - 1)) * shared->stride);
+}
+
+/*
+* static 将命令写入共享历史记录
+* 原子递增head取得位置 写入期间版本号为奇数
+*/
+static void
+history_shared_push(struct history_shared* shared, uint32_t owner, const char* cmd, int len)
+{
+    struct history_shared_slot* slot;
+    uint64_t pos;
+
+    if(len > (int)shared->max_size)
+        return;
+
+    pos = __atomic_fetch_add(&shared->head, 1, __ATOMIC_RELAXED);
+    slot = history_shared_slot(shared, pos);
+    __atomic_store_n(&slot->seq, 2 * pos + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->owner = owner;
+    slot->len = len;
+    memcpy(slot->str, cmd, len);
+    __atomic_store_n(&slot->seq, 2 * pos + 2, __ATOMIC_RELEASE);
+}
+
+int 
+history_add_new(struct history* hist, const char* cmd, int len, int mode)
+{
+    if(!hist || !cmd || hist->history_cmd_max_num < 0)
+        return -1;
+
+    int ret;
+
+    if((ret = history_insert(hist, cmd, len)) < 0)
+        return -1;
+
+    if(mode == 0)
+    {
+        hist->now = -1;
     }
 
+    //写入共享历史记录
+    if(hist->shared && ret == 0)
+        history_shared_push(hist->shared, hist->shared_owner, cmd, len);
+
+    //追加至历史记录文件
+    if(hist->file_fd >= 0 && ret == 0)
+        return history_append_file(hist, cmd, len);
+
     return 0;
 }
 
@@ -113,35 +839,172 @@ history_del_head(struct history* hist)
 {
     if(!hist)
         return -1;
-    if(hist->head == NULL)
-        return -1;
     if(hist->history_cmd_num == 0)
         return 0;
-    
-    history_cmd_t* del_ptr;
 
-    //delete
-    if(hist->history_cmd_num == 1)//只有一个节点
+    struct history_entry* e;
+
+    if(hist->dedup_slots)
+        history_dedup_del(hist, 0);
+
+    //移动环形缓冲区头部 之后相邻的空位一起回收
+    do
     {
-        del_ptr = hist->head->next;
-        if(del_ptr == NULL)
-            return -1;
-        hist->head->next = NULL;
-        hist->head->prev = NULL;
+        e = history_entry(hist, 0);
+        if(e->len & HISTORY_ENTRY_DEAD)
+        {
+            hist->str_holes -= (e->len & ~HISTORY_ENTRY_DEAD) + 1;
+            --hist->history_dead_num;
+        }
+        ++hist->entry_first;
+        if(hist->entry_first == hist->entry_cap)
+            hist->entry_first = 0;
         --hist->history_cmd_num;
-        delete_command(del_ptr);
+
+        //当前历史命令的序号随之前移
+        if(hist->now > 0)
+            --hist->now;
+        else if(hist->now == 0 && hist->history_cmd_num == 0)
+            hist->now = -1;
+    }while(hist->history_cmd_num > 0 && (history_entry(hist, 0)->len & HISTORY_ENTRY_DEAD));
+    if(hist->history_cmd_num > 0)
+        hist->str_head = history_entry(hist, 0)->off;
+    return 0;
+}
+
+char*
+history_get_cmd(struct history* hist, int idx)
+{
+    if(!hist || idx < 0 || idx >= hist->history_cmd_num ||
+       (history_entry(hist, idx)->len & HISTORY_ENTRY_DEAD))
+        return NULL;
+    return hist->strs + history_entry(hist, idx)->off;
+}
+
+/*
+* static 序号为idx的命令是否包含str(prefix为1时需以str开头)
+*/
+static int
+history_match(struct history* hist, int idx, const char* str, int len, int prefix)
+{
+    struct history_entry* e = history_entry(hist, idx);
+
+    if(e->len & HISTORY_ENTRY_DEAD)
+        return 0;
+    if(prefix)
+        return e->len >= (unsigned int)len && !memcmp(hist->strs + e->off, str, len);
+    return memmem(hist->strs + e->off, e->len, str, len) != NULL;
+}
+
+/*
+* static 选择str对应的最短的列表 用于查找
+* 返回NULL说明不可能存在匹配的命令
+*/
+static struct history_posting*
+history_index_best(struct history* hist, const char* str, int len, int prefix)
+{
+    struct history_posting* best = NULL;
+    struct history_posting* p;
+    int i;
+
+    if(prefix)
+    {
+        best = history_index_slot(hist->index, prefix_key(str, len < 3 ? len : 3));
+        if(best->key == 0)
+            return NULL;
     }
-    else//多节点
+    for(i = 0; i + 3 <= len; ++i)
     {
-        del_ptr = hist->head->next;
-        if(del_ptr == NULL)
-            return -1;
-        hist->head->next = del_ptr->next;
-        del_ptr->next->prev = hist->head;
-        --hist->history_cmd_num;
-        delete_command(del_ptr);
+        p = history_index_slot(hist->index, trigram_key(str + i));
+        if(p->key == 0)
+            return NULL;
+        if(best == NULL || p->len - p->start < best->len - best->start)
+            best = p;
     }
-    return 0;
+    return best;
+}
+
+/*
+* static 查找包含str(prefix为1时需以str开头)的命令
+* 索引不可用时逐条查找
+*
+* from: 起始序号(不含) 可为-1或history_cmd_num
+*  dir: 小于0时向更久的命令查找 大于0时向更新的命令查找
+*
+* 返回值为命令序号 -1为不存在
+*/
+static int
+history_find(struct history* hist, const char* str, int len, int from, int dir, int prefix)
+{
+    struct history_posting* p;
+    uint32_t lo, hi, mid, seq, seq_first, seq_from;
+    int i;
+
+    //无法使用索引时逐条查找
+    if((!prefix && len < 3) || (hist->index == NULL && history_index_build(hist) < 0))
+    {
+        for(i = from + (dir < 0 ? -1 : 1); i >= 0 && i < hist->history_cmd_num; i += (dir < 0 ? -1 : 1))
+        {
+            if(history_match(hist, i, str, len, prefix))
+                return i;
+        }
+        return -1;
+    }
+
+    if((p = history_index_best(hist, str, len, prefix)) == NULL)
+        return -1;
+
+    //二分查找第一个大于seq_from(向更久的命令查找时为不小于)的位置
+    seq_first = history_entry(hist, 0)->seq;
+    if(from < 0)
+        seq_from = seq_first - 1;
+    else if(from < hist->history_cmd_num)
+        seq_from = history_entry(hist, from)->seq;
+    else
+        seq_from = hist->seq_next;
+    lo = p->start;
+    hi = p->len;
+    while(lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if(dir < 0 ? p->seqs[mid] < seq_from : p->seqs[mid] <= seq_from)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    //逐一验证 跳过已删除的命令
+    if(dir < 0)
+    {
+        while(lo > p->start && (seq = p->seqs[--lo]) >= seq_first)
+        {
+            if((i = history_seq_find(hist, seq)) >= 0 && history_match(hist, i, str, len, prefix))
+                return i;
+        }
+        return -1;
+    }
+    for(; lo < p->len; ++lo)
+    {
+        seq = p->seqs[lo];
+        if(seq < seq_first)
+            continue;
+        if((i = history_seq_find(hist, seq)) >= 0 && history_match(hist, i, str, len, prefix))
+            return i;
+    }
+    return -1;
+}
+
+int
+history_search(struct history* hist, const char* str, int len, int before)
+{
+    if(!hist || !str || len < 0 || hist->entries == NULL)
+        return -1;
+
+    if(before > hist->history_cmd_num)
+        before = hist->history_cmd_num;
+    if(before <= 0)
+        return -1;
+    return history_find(hist, str, len, before, -1, 0);
 }
 
 char* 
@@ -149,16 +1012,17 @@ history_get_prev(struct history* hist)
 {
     if(!hist)
         return NULL;
-    if(hist->now == NULL && hist->history_cmd_num == 0)
-        return NULL;
-    if(hist->now != NULL && hist->now->prev == hist->head)
+    if(hist->history_cmd_num == 0 || hist->now == 0)
         return NULL;
     
-    if(hist->now == NULL)
-        hist->now = hist->head->prev;
+    if(hist->now < 0)
+        hist->now = hist->history_cmd_num - 1;
     else
-        hist->now = hist->now->prev;
-    return hist->now->cmd;
+        --hist->now;
+    //跳过空位 最久的命令不为空位
+    while(history_entry(hist, hist->now)->len & HISTORY_ENTRY_DEAD)
+        --hist->now;
+    return history_get_cmd(hist, hist->now);
 }
 
 char* 
@@ -166,38 +1030,95 @@ history_get_next(struct history* hist)
 {
     if(!hist)
         return NULL;
-    if(hist->now == NULL)
+    if(hist->now < 0)
         return NULL;
     
-    hist->now = hist->now->next;
+    ++hist->now;
+    while(hist->now < hist->history_cmd_num && (history_entry(hist, hist->now)->len & HISTORY_ENTRY_DEAD))
+        ++hist->now;
     //回到用户输入 则返回user_input_buf
-    if(hist->now == hist->head)
+    if(hist->now >= hist->history_cmd_num)
     {
-        hist->now = NULL;
+        hist->now = -1;
         return hist->user_input_buf;
     }
     //其余返回储存的cmd
-    return hist->now->cmd;
+    return history_get_cmd(hist, hist->now);
+}
+
+char*
+history_get_prev_prefix(struct history* hist, const char* prefix, int len)
+{
+    if(!hist || !prefix)
+        return NULL;
+    if(len <= 0)
+        return history_get_prev(hist);
+    if(hist->history_cmd_num == 0 || hist->now == 0)
+        return NULL;
+
+    int idx;
+
+    idx = history_find(hist, prefix, len, hist->now < 0 ? hist->history_cmd_num : hist->now, -1, 1);
+    if(idx < 0)
+        return NULL;
+    hist->now = idx;
+    return history_get_cmd(hist, idx);
+}
+
+char*
+history_get_next_prefix(struct history* hist, const char* prefix, int len)
+{
+    if(!hist || !prefix)
+        return NULL;
+    if(len <= 0)
+        return history_get_next(hist);
+    if(hist->now < 0)
+        return NULL;
+
+    int idx;
+
+    //之后没有匹配的命令 回到用户输入
+    idx = history_find(hist, prefix, len, hist->now, 1, 1);
+    if(idx < 0)
+    {
+        hist->now = -1;
+        return hist->user_input_buf;
+    }
+    hist->now = idx;
+    return history_get_cmd(hist, idx);
 }
 
 void
-history_save_user_input(struct history* hist, char* input)
+history_save_user_input(struct history* hist, const char* input)
 {
     if(!hist || !input)
         return;
 
-    unsigned int len = 0;
-    char temp_c;
+    int len = 0, cap;
+    char* buf;
 
-    temp_c = input[len];
-    while(temp_c != '\n' && temp_c != '\0')
-    {
-        if(len >= hist->command_buf_max_size)
-            break;
-        hist->user_input_buf[len] = temp_c;
+    while(input[len] != '\n' && input[len] != '\0' && len < hist->command_buf_max_size)
         ++len;
-        temp_c = input[len];
+    //扩容失败时截断
+    if(len + 1 > hist->user_input_buf_cap)
+    {
+        cap = hist->user_input_buf_cap ? hist->user_input_buf_cap : HISTORY_AVG_CMD_SIZE + 1;
+        while(cap < len + 1)
+            cap *= 2;
+        buf = realloc(hist->user_input_buf, cap);
+        if(buf)
+        {
+            hist->user_input_buf = buf;
+            hist->user_input_buf_cap = cap;
+        }
+        else if(len + 1 > hist->user_input_buf_cap)
+        {
+            len = hist->user_input_buf_cap - 1;
+        }
     }
+    if(len < 0)
+        return;
+    memcpy(hist->user_input_buf, input, len);
     hist->user_input_buf[len] = '\0';
     hist->user_input_buf_len = len;
 }
@@ -208,22 +1129,382 @@ history_free(struct history* hist)
     if(!hist)
         return;
 
-    history_cmd_t* temp_ptr;
-    history_cmd_t* del_ptr;
+    //free命令及字符串缓冲区
+    history_index_free(hist);
+    free(hist->dedup_slots);
+    hist->dedup_slots = NULL;
+    free(hist->entries);
+    free(hist->strs);
+    hist->entries = NULL;
+    hist->strs = NULL;
+    hist->history_cmd_num = 0;
+    hist->history_dead_num = 0;
+    hist->str_holes = 0;
+
+    //free输入缓冲区
+    free(hist->user_input_buf);
+
+    //关闭历史记录文件
+    if(hist->file_fd >= 0)
+        close(hist->file_fd);
+    hist->file_fd = -1;
+    free(hist->file_path);
+    hist->file_path = NULL;
 
-    //free每一条命令
-    temp_ptr = hist->head->next;
-    while(hist->history_cmd_num > 0)
+    //释放共享历史记录
+    history_shared_free(hist->shared);
+    hist->shared = NULL;
+}
+
+/*
+* static 从映射的文件内容中读取命令
+* 限制最大历史记录数时 从文件末尾向前查找最近的命令 无需扫描整个文件
+*
+* 返回值为文件中的命令数(空行不计)
+*/
+static int
+history_load_buf(struct history* hist, char* buf, size_t size)
+{
+    char** starts;
+    int* lens;
+    char* end = buf + size;
+    char* p;
+    char* nl;
+    int want = hist->history_cmd_max_num;
+    int count = 0, num, i;
+
+    //无限制时 从前向后逐行读取
+    if(want == 0)
     {
-        del_ptr = temp_ptr;
-        temp_ptr = temp_ptr->next;
-        --hist->history_cmd_num;
-        delete_command(del_ptr);
+        for(p = buf; p < end; p = nl + 1)
+        {
+            nl = memchr(p, '\n', end - p);
+            if(nl == NULL)
+                nl = end;
+            if(nl > p && history_insert(hist, p, nl - p) >= 0)
+                ++count;
+        }
+        return count;
     }
-    delete_command(hist->head);
 
-    //free输入缓冲区
-    free(hist->user_input_buf);
+    starts = malloc(want * sizeof(char*));
+    lens = malloc(want * sizeof(int));
+    if(starts == NULL || lens == NULL)
+    {
+        free(starts);
+        free(lens);
+        return 0;
+    }
+
+    //从后向前 记录最近的want条命令
+    if(end > buf && end[-1] == '\n')
+        --end;
+    while(end > buf && count < want)
+    {
+        nl = memrchr(buf, '\n', end - buf);
+        p = nl ? nl + 1 : buf;
+        if(end > p && end - p <= hist->command_buf_max_size)
+        {
+            starts[count] = p;
+            lens[count] = end - p;
+            ++count;
+        }
+        end = nl ? nl : buf;
+    }
+
+    //剩余部分只统计行数
+    num = count;
+    for(p = buf; p < end && (p = memchr(p, '\n', end - p)) != NULL; ++p)
+        ++num;
+    if(end > buf && end[-1] != '\n')
+        ++num;
+
+    //按时间顺序插入
+    for(i = count - 1; i >= 0; --i)
+        history_insert(hist, starts[i], lens[i]);
+    free(starts);
+    free(lens);
+
+    return num;
+}
+
+int
+history_load_file(struct history* hist, const char* path, int sync)
+{
+    if(!hist || !path || hist->entries == NULL || hist->history_cmd_max_num < 0)
+        return -1;
+
+    struct stat st;
+    char* buf;
+    int fd, compact = 0;
+
+    fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if(fd < 0)
+        return -1;
+    if(fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    //替换之前使用的文件
+    if(hist->file_fd >= 0)
+        close(hist->file_fd);
+    free(hist->file_path);
+    hist->file_fd = fd;
+    hist->file_path = strdup(path);
+    hist->file_num = 0;
+    hist->file_sync = sync;
+    if(hist->file_path == NULL)
+    {
+        close(fd);
+        hist->file_fd = -1;
+        return -1;
+    }
+
+    //读取文件中的命令
+    if(st.st_size > 0)
+    {
+        buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(buf == MAP_FAILED)
+        {
+            close(fd);
+            free(hist->file_path);
+            hist->file_fd = -1;
+            hist->file_path = NULL;
+            return -1;
+        }
+        hist->file_num = history_load_buf(hist, buf, st.st_size);
+        //最后一行没有换行符(上次写入不完整) 需重写文件 以免与新命令相连
+        compact = (buf[st.st_size - 1] != '\n');
+        munmap(buf, st.st_size);
+    }
+    hist->now = -1;
+
+    //文件中的命令过多 立即重写
+    if(hist->history_cmd_max_num > 0 &&
+       hist->file_num > hist->history_cmd_max_num * HISTORY_COMPACT_FACTOR)
+        compact = 1;
+    if(compact)
+        return history_compact_file(hist);
+    return 0;
 }
 
+int
+history_compact_file(struct history* hist)
+{
+    if(!hist || hist->file_fd < 0 || !hist->file_path)
+        return -1;
+
+    struct stat st;
+    char* tmp_path;
+    char* buf;
+    char* end;
+    char* p;
+    size_t size, done;
+    ssize_t ret;
+    int fd, num = 0, ok;
 
+    //重写期间持有独占锁 其他进程的追加在重写完成后写入新文件
+    if(history_file_lock(hist, LOCK_EX) < 0)
+        return -1;
+    tmp_path = malloc(strlen(hist->file_path) + sizeof(".tmp"));
+    if(tmp_path == NULL || fstat(hist->file_fd, &st) < 0)
+    {
+        free(tmp_path);
+        flock(hist->file_fd, LOCK_UN);
+        return -1;
+    }
+    sprintf(tmp_path, "%s.tmp", hist->file_path);
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if(fd < 0)
+    {
+        free(tmp_path);
+        flock(hist->file_fd, LOCK_UN);
+        return -1;
+    }
+
+    //保留文件中最近的命令(包括其他进程写入的) 最后一行补全换行符
+    ok = 1;
+    if(st.st_size > 0)
+    {
+        buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, hist->file_fd, 0);
+        if(buf == MAP_FAILED)
+        {
+            ok = 0;
+        }
+        else
+        {
+            end = buf + st.st_size;
+            if(end[-1] == '\n')
+                --end;
+            p = end;
+            while(p > buf && (hist->history_cmd_max_num == 0 || num < hist->history_cmd_max_num))
+            {
+                end = p;
+                p = memrchr(buf, '\n', end - buf);
+                p = p ? p : buf;
+                if(end > p + (*p == '\n'))
+                    ++num;
+            }
+            if(p > buf)
+                ++p;
+            size = buf + st.st_size - p;
+            for(done = 0; done < size; done += ret)
+            {
+                ret = write(fd, p + done, size - done);
+                if(ret < 0 && errno == EINTR)
+                {
+                    ret = 0;
+                    continue;
+                }
+                if(ret < 0)
+                    break;
+            }
+            if(done < size || (size > 0 && p[size - 1] != '\n' && write(fd, "\n", 1) != 1))
+                ok = 0;
+            munmap(buf, st.st_size);
+        }
+    }
+    if(!ok || (hist->file_sync == HISTORY_SYNC_ALWAYS && fdatasync(fd) < 0))
+    {
+        close(fd);
+        unlink(tmp_path);
+        free(tmp_path);
+        flock(hist->file_fd, LOCK_UN);
+        return -1;
+    }
+    close(fd);
+
+    //替换原文件 并重新以O_APPEND打开
+    //关闭原文件时释放锁 等待的进程发现文件已被替换后重新打开
+    if(rename(tmp_path, hist->file_path) < 0)
+    {
+        unlink(tmp_path);
+        free(tmp_path);
+        flock(hist->file_fd, LOCK_UN);
+        return -1;
+    }
+    free(tmp_path);
+    fd = open(hist->file_path, O_RDWR | O_APPEND | O_CLOEXEC);
+    close(hist->file_fd);
+    hist->file_fd = fd;
+    if(fd < 0)
+        return -1;
+    hist->file_num = num;
+
+    return 0;
+}
+
+struct history_shared*
+history_shared_new(int max_num, int max_size)
+{
+    if(max_num <= 0 || max_size <= 0)
+        return NULL;
+
+    struct history_shared* shared;
+    uint32_t cap;
+
+    for(cap = 16; cap < (uint32_t)max_num; cap *= 2)
+        ;
+    shared = malloc(sizeof(struct history_shared));
+    if(shared == NULL)
+        return NULL;
+    shared->head = 0;
+    shared->cap = cap;
+    shared->max_size = max_size;
+    //槽位按8字节对齐 保证版本号的原子操作
+    shared->stride = (sizeof(struct history_shared_slot) + max_size + 7) & ~7u;
+    shared->owner_next = 0;
+    shared->refcnt = 1;
+    shared->slots = calloc(cap, shared->stride);
+    if(shared->slots == NULL)
+    {
+        free(shared);
+        return NULL;
+    }
+    return shared;
+}
+
+struct history_shared*
+history_shared_get(struct history_shared* shared)
+{
+    if(!shared)
+        return NULL;
+    __atomic_add_fetch(&shared->refcnt, 1, __ATOMIC_RELAXED);
+    return shared;
+}
+
+void
+history_shared_free(struct history_shared* shared)
+{
+    if(!shared || __atomic_sub_fetch(&shared->refcnt, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+    free(shared->slots);
+    free(shared);
+}
+
+int
+history_attach_shared(struct history* hist, struct history_shared* shared)
+{
+    if(!hist || !shared || hist->entries == NULL)
+        return -1;
+
+    uint64_t head;
+
+    history_shared_free(hist->shared);
+    hist->shared = history_shared_get(shared);
+    hist->shared_owner = __atomic_add_fetch(&shared->owner_next, 1, __ATOMIC_RELAXED);
+
+    //读入仍保留的命令
+    head = __atomic_load_n(&shared->head, __ATOMIC_ACQUIRE);
+    hist->shared_pos = head > shared->cap ? head - shared->cap : 0;
+    history_sync_shared(hist);
+    return 0;
+}
+
+void
+history_sync_shared(struct history* hist)
+{
+    if(!hist || !hist->shared)
+        return;
+
+    struct history_shared* shared = hist->shared;
+    struct history_shared_slot* slot;
+    uint64_t head, pos, seq;
+    uint32_t owner, len;
+    char* buf = NULL;
+
+    head = __atomic_load_n(&shared->head, __ATOMIC_ACQUIRE);
+    pos = hist->shared_pos;
+    //落后过多 跳过已被覆盖的命令
+    if(head - pos > shared->cap)
+        pos = head - shared->cap;
+
+    for(; pos < head; ++pos)
+    {
+        slot = history_shared_slot(shared, pos);
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        //尚未写入完成 下次再读
+        if(seq < 2 * pos + 2)
+            break;
+        //已被覆盖
+        if(seq > 2 * pos + 2)
+            continue;
+
+        owner = slot->owner;
+        len = slot->len;
+        if(owner == hist->shared_owner || len > shared->max_size)
+            continue;
+        if(buf == NULL && (buf = malloc(shared->max_size)) == NULL)
+            break;
+        memcpy(buf, slot->str, len);
+        //copy期间被覆盖时内容无效
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+            continue;
+        history_insert(hist, buf, len);
+    }
+    hist->shared_pos = pos;
+    free(buf);
+}
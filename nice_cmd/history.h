@@ -8,53 +8,234 @@
 #ifndef _HISTORY_H_
 #define _HISTORY_H_
 
+#include<stdint.h>
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
 /*
-* 命令结构体 储存着一条历史命令
-* 双向链表结构
+* 历史记录文件的同步策略
+*
+*   HISTORY_SYNC_NONE: 仅写入 由系统决定何时落盘
+* HISTORY_SYNC_ALWAYS: 每条命令写入后fdatasync
+*/
+#define HISTORY_SYNC_NONE   0
+#define HISTORY_SYNC_ALWAYS 1
+
+/*
+* 历史记录文件中的命令数超过最大历史记录数的HISTORY_COMPACT_FACTOR倍时
+* 使用内存中的历史记录重写文件
+*/
+#define HISTORY_COMPACT_FACTOR 2
+
+/*
+* 重复命令的处理方式
+*
+*        HISTORY_DEDUP_NONE: 记录所有命令
+* HISTORY_DEDUP_CONSECUTIVE: 与最新的命令相同时不记录
+*         HISTORY_DEDUP_ALL: 与任一历史命令相同时 将其移至最新 不占用新的位置
+*                            原有的命令标记为空位 有最大历史记录数时命令缓冲区多预留一半容量
+*                            空位用尽后整理命令缓冲区
+*/
+#define HISTORY_DEDUP_NONE        0
+#define HISTORY_DEDUP_CONSECUTIVE 1
+#define HISTORY_DEDUP_ALL         2
+
+/*
+* 每条命令的平均长度估计 用于决定字符串环形缓冲区的初始大小
+* 有最大历史记录数时 字符串缓冲区空间不足时先扩容 再删除最久的命令
+* 扩容上限为命令缓冲区容量*单条命令最大size 且不超过HISTORY_STR_FULL_SIZE
+* 空位的字符串占用超过字符串缓冲区的1/4时 先整理再删除最久的命令
+*/
+#define HISTORY_AVG_CMD_SIZE 64
+#define HISTORY_STR_FULL_SIZE (1024 * 1024)
+
+/*
+* 不限制历史记录数时的初始容量
+*/
+#define HISTORY_INIT_NUM 64
+
+/*
+* 历史命令 储存在entries环形缓冲区中
+*
+* off: 命令在字符串环形缓冲区中的位置 以'\0'结尾
+* len: 命令长度 最高位(HISTORY_ENTRY_DEAD)为1时为去重删除后留下的空位
+* seq: 命令的全局序号 添加时确定且不再改变 从旧到新递增
+*/
+#define HISTORY_ENTRY_DEAD 0x80000000u
+struct history_entry
+{
+    unsigned int off;
+    unsigned int len;
+    uint32_t seq;
+};
+
+/*
+* 三元组索引 用于在历史记录中查找子串及前缀
+* 每个三元组(连续的3个字符)对应一个包含它的命令序号列表 序号递增
+* 命令开头的1~3个字符另外对应一个列表 用于前缀查找
+* 最久的命令被删除后 其序号在之后追加时才从列表头部移除
+* 去重时从中间移除的命令 其序号在查找时跳过
+*
+*      key: 三元组 (c0 << 16 | c1 << 8 | c2) + 1 为0时槽位为空
+*           命令开头的n个字符为 (n << 24 | c0 << 16 | c1 << 8 | c2) + 1
+*    start: 列表中第一个有效序号的位置
+*      len: 列表长度
+*      cap: 列表容量
+*     seqs: 命令序号列表(malloc/需free)
+*/
+struct history_posting
+{
+    uint32_t key;
+    uint32_t start;
+    uint32_t len;
+    uint32_t cap;
+    uint32_t* seqs;
+};
+
+/*
+* 三元组索引主体 开放寻址哈希表
+* 首次查找时由所有历史命令建立 之后随命令的添加更新
+*
+*    slots: 哈希表(malloc/需free)
+* nb_slots: 槽位数 为2的幂
+*  nb_used: 已使用的槽位数
+*/
+struct history_index
+{
+    struct history_posting* slots;
+    uint32_t nb_slots;
+    uint32_t nb_used;
+};
+
+#define HISTORY_INDEX_INIT_SLOTS 1024
+
+/*
+* 去重哈希表的槽位 线性探测 删除时后移填补
+*
+* hash: 命令字符串的哈希值
+*  seq: 命令的全局序号 为0时槽位为空
+*/
+struct history_dedup_slot
+{
+    uint32_t hash;
+    uint32_t seq;
+};
+
+/*
+* 共享历史记录 多个struct history(可位于不同线程)通过其交换新命令
+* 添加命令时原子递增head取得写入位置 无需加锁
+* 每个槽位带有版本号 读取前后版本号一致时内容有效
+* 读取过慢时被覆盖的命令将被跳过
+*
+*       head: 下一条命令的写入位置 原子递增
+*        cap: 槽位数 为2的幂
+*   max_size: 单条命令的最大size
+*     stride: 每个槽位的字节数
+* owner_next: 上一个加入的history的id 原子递增
+*     refcnt: 引用计数 原子操作
+*      slots: 槽位内存(malloc/需free)
+*/
+struct history_shared
+{
+    uint64_t head;
+    uint32_t cap;
+    uint32_t max_size;
+    uint32_t stride;
+    uint32_t owner_next;
+    int refcnt;
+    char* slots;
+};
+
+/*
+* 共享历史记录的槽位
 *
-*  cmd: 指向储存命令的内存(malloc/需free)
-*  len: 命令长度
-* prev: 上一条命令
-* next: 下一条命令
+*   seq: 版本号 写入位置pos的命令时为2 * pos + 1 完成后为2 * pos + 2
+* owner: 写入命令的history的id
+*   len: 命令长度
+*   str: 命令内容
 */
-struct command
+struct history_shared_slot
 {
-    char* cmd;
-    int len;
-    struct command* prev;
-    struct command* next;
+    uint64_t seq;
+    uint32_t owner;
+    uint32_t len;
+    char str[];
 };
-typedef struct command history_cmd_t;
 
 /*
 * 历史记录主体
-* head->prev = 尾历史记录
-* head->next = 头历史记录
+* 所有命令储存在两块连续内存中 字符串缓冲区达到上限后添加/删除命令时不再分配内存
+* entries为命令的环形缓冲区 strs为字符串的环形缓冲区
+* 字符串总是连续储存 缓冲区末尾放不下时从头开始
 *
-*                 head: 头节点 记录历史命令头尾(malloc/需free)
-*                  now: 指向当前历史命令
-*      history_cmd_num: 当前历史记录数
+*              entries: 命令环形缓冲区(malloc/需free)
+*            entry_cap: 命令环形缓冲区容量
+*          entry_first: 最久的命令在entries中的下标
+*                 strs: 字符串环形缓冲区(malloc/需free)
+*              str_cap: 字符串环形缓冲区容量
+*             str_head: 最久的命令字符串的位置
+*             str_tail: 下一条命令字符串的写入位置
+*            str_holes: 空位的字符串占用的字节数 较多时整理字符串缓冲区
+*             seq_next: 下一条命令的全局序号 从1开始
+*                index: 三元组索引 未进行过查找时为NULL
+*                dedup: 重复命令的处理方式 HISTORY_DEDUP_*
+*          dedup_slots: 去重哈希表 仅HISTORY_DEDUP_ALL时使用(malloc/需free)
+*       dedup_nb_slots: 去重哈希表槽位数 为2的幂
+*                  now: 当前历史命令的序号 0为最久的命令 -1为用户输入
+*      history_cmd_num: 当前历史记录数 包括空位
+*     history_dead_num: 去重时从中间删除的命令留下的空位数 最久/最新的命令不为空位
 *  history_cmd_max_num: 最大历史记录数 0为无限制 负数为不记录
-* command_buf_max_size: struct command中cmd的最大size
+* command_buf_max_size: 单条命令的最大size
 *
 * [以下两个变量用于用户查询历史记录时,储存已经输入的内容]
-*       user_input_buf: 用户输入缓冲区(malloc/需free)
+*       user_input_buf: 用户输入缓冲区(malloc/需free 按需扩容)
 *   user_input_buf_len: 输入长度
+*   user_input_buf_cap: 用户输入缓冲区容量
+*
+* [以下变量用于历史记录文件 由history_load_file()设置]
+*              file_fd: 历史记录文件 以O_APPEND打开 -1为不使用文件
+*            file_path: 文件路径 用于重写文件(malloc/需free)
+*             file_num: 文件中的命令数
+*            file_sync: 同步策略 HISTORY_SYNC_*
+*
+* [以下变量用于共享历史记录 由history_attach_shared()设置]
+*               shared: 共享历史记录 NULL为不共享
+*         shared_owner: 此history在共享历史记录中的id
+*           shared_pos: 下一条要读取的共享命令的位置
 */
 struct history
 {
-    history_cmd_t* head;
-    history_cmd_t* now;
+    struct history_entry* entries;
+    unsigned int entry_cap;
+    unsigned int entry_first;
+    char* strs;
+    unsigned int str_cap;
+    unsigned int str_head;
+    unsigned int str_tail;
+    unsigned int str_holes;
+    uint32_t seq_next;
+    struct history_index* index;
+    int dedup;
+    struct history_dedup_slot* dedup_slots;
+    uint32_t dedup_nb_slots;
+    int now;
     int history_cmd_num;
+    int history_dead_num;
     int history_cmd_max_num;
     int command_buf_max_size;
     char* user_input_buf;
     int user_input_buf_len;
+    int user_input_buf_cap;
+    int file_fd;
+    char* file_path;
+    int file_num;
+    int file_sync;
+    struct history_shared* shared;
+    uint32_t shared_owner;
+    uint64_t shared_pos;
 };
 
 /*
@@ -62,52 +243,49 @@ struct history
 * 即在执行历史记录查询时
 * 需要将此命令储存至user_input_buf
 */
-#define IS_NOT_HISTORY_CMD(hist) ((hist)->now == (hist)->head->prev)
+#define IS_NOT_HISTORY_CMD(hist) ((hist)->now < 0)
 
 /*
-* 新建struct command并返回
-*
-*      cmd: 需要储存的命令
-*      len: 需要储存命令的长度
-* max_size: 最大储存长度/对应command_buf_max_size
+* 历史记录系统初始化
 *
-* 此处使用malloc创建,返回一个struct command指针
+*     hist: 指向要初始化的struct history
+*  max_num: history中最多记录max_num条命令
+* max_size: history中单条命令的最大size
 */
-history_cmd_t* new_command(char* cmd, int len, int max_size);
+void history_init(struct history* hist, int max_num, int max_size);
 
 /*
-* free指定struct command
-* 首先free(command->cmd)
-* 随后free(command)
+* 设置重复命令的处理方式 默认为HISTORY_DEDUP_NONE
+* 设为HISTORY_DEDUP_ALL时 已有的重复命令只保留最新的一条
+*
+* mode: HISTORY_DEDUP_*
 *
-* command: 指向要free的命令结构体
+* 返回0为成功 -1为失败
 */
-void delete_command(history_cmd_t* command);
+int history_set_dedup(struct history* hist, int mode);
 
 /*
-* 历史记录系统初始化
-*
-*     hist: 指向要初始化的struct history
-*  max_num: history中最多记录max_num条命令
-* max_size: history中单条命令的最大size
+* 修改单条命令的最大size 已记录的命令不受影响
+* 超过max_size的命令不会被记录
 */
-void history_init(struct history* hist, int max_num, int max_size);
+void history_set_max_size(struct history* hist, int max_size);
 
 /*
 * 添加新历史记录
+* 使用历史记录文件时 命令同时通过一次write追加至文件末尾
+* 命令与最新的命令重复而未记录时 不写入文件
 * 
 * hist: 指向要要添加命令的struct history
 *  cmd: 要添加的命令
 *  len: 命令的长度
-* mode: 模式 当为0时 命令添加后hist->now复位为NULL
+* mode: 模式 当为0时 命令添加后hist->now复位为-1
 *
 * 返回0为成功 -1为失败
 */
-int history_add_new(struct history* hist, char* cmd, int len, int mode);
+int history_add_new(struct history* hist, const char* cmd, int len, int mode);
 
 /*
 * 删除最久的一条历史记录
-* 即head->next
 * 
 * hist: 指向要要删除命令的struct history
 *
@@ -115,6 +293,24 @@ int history_add_new(struct history* hist, char* cmd, int len, int mode);
 */
 int history_del_head(struct history* hist);
 
+/*
+* 获取序号为idx的历史命令 0为最久的命令
+* 返回NULL为不存在
+*/
+char* history_get_cmd(struct history* hist, int idx);
+
+/*
+* 从序号before之前(不含)向前查找包含str的最近一条历史命令
+* 查询长度不少于3时使用三元组索引 只需验证包含所有三元组的命令
+*
+*    str: 要查找的内容 不需以'\0'结尾
+*    len: 内容长度
+* before: 从此序号之前开始查找 为history_cmd_num时从最新的命令开始
+*
+* 返回值为命令序号 -1为不存在
+*/
+int history_search(struct history* hist, const char* str, int len, int before);
+
 /*
 * 查询上一条历史记录
 * 返回值为查询结果 NULL为不存在
@@ -127,15 +323,89 @@ char* history_get_prev(struct history* hist);
 */
 char* history_get_next(struct history* hist);
 
+/*
+* 获取上一条以prefix开头的历史命令 通过索引查找 不逐条比较
+* len为0时与history_get_prev()相同
+*
+* prefix: 前缀 不需以'\0'结尾
+*    len: 前缀长度
+*
+* 返回NULL为不存在 此时hist->now不变
+*/
+char* history_get_prev_prefix(struct history* hist, const char* prefix, int len);
+
+/*
+* 获取下一条以prefix开头的历史命令
+* 不存在时回到用户输入 返回user_input_buf
+*/
+char* history_get_next_prefix(struct history* hist, const char* prefix, int len);
+
 /*
 * 将用户输入保存至user_input_buf
 *
 * input: 一个储存用户输入的字符串指针 以'\n'或'\0'结尾
 */
-void history_save_user_input(struct history* hist, char* input);
+void history_save_user_input(struct history* hist, const char* input);
+
+/*
+* 使用历史记录文件 文件不存在时创建
+* 通过mmap从文件末尾向前读取最近的history_cmd_max_num条命令
+* 之后添加的命令均追加至此文件
+* 文件中的命令数过多时(参照HISTORY_COMPACT_FACTOR) 立即重写文件
+*
+* hist: 指向struct history
+* path: 文件路径
+* sync: 同步策略 HISTORY_SYNC_*
+*
+* 返回0为成功 -1为失败
+*/
+int history_load_file(struct history* hist, const char* path, int sync);
+
+/*
+* 重写历史记录文件 只保留文件中最近的history_cmd_max_num条命令(包括其他进程写入的)
+* 持有文件锁(flock)期间先写入临时文件 再通过rename替换
+* 其他进程追加前比较文件与file_path的inode 已被替换时重新打开
+*
+* 返回0为成功 -1为失败
+*/
+int history_compact_file(struct history* hist);
+
+/*
+* 新建共享历史记录
+*
+*  max_num: 保留的命令数 不足2的幂时向上取整
+* max_size: 单条命令的最大size 超出的命令不共享
+*
+* 返回NULL为失败
+*/
+struct history_shared* history_shared_new(int max_num, int max_size);
+
+/*
+* 增加共享历史记录的引用计数
+*/
+struct history_shared* history_shared_get(struct history_shared* shared);
+
+/*
+* 减少共享历史记录的引用计数 为0时free
+*/
+void history_shared_free(struct history_shared* shared);
+
+/*
+* 使hist使用共享历史记录 hist会持有其引用
+* 之后添加的命令同时写入共享历史记录 并立即读入其中已有的命令
+*
+* 返回0为成功 -1为失败
+*/
+int history_attach_shared(struct history* hist, struct history_shared* shared);
+
+/*
+* 读入其他history写入共享历史记录的新命令
+* 命令按写入顺序添加至hist 会改变命令序号 应在开始查询历史记录前调用
+*/
+void history_sync_shared(struct history* hist);
 
 /*
-* free历史记录系统
+* free历史记录系统 并关闭历史记录文件
 *
 * hist: 指向要free的struct history
 */
@@ -33,9 +33,12 @@
  */
 
 #include<stdio.h>
+#include<stdlib.h>
+#include<stdarg.h>
 #include<string.h>
 #include<ctype.h>
 #include"parse.h"
+#include"parse_string.h"
 #include"cmdline.h"
 
 /*
@@ -94,10 +97,103 @@ nb_common_chars(const char* s1, const char* s2)
 }
 
 /*
-* 尝试对buf内的字符串依照命令inst进行匹配
+* 将buf切分为单词
+*
+*    line: 储存切分结果
+*     buf: 输入行
+* comment: 为1时遇到注释符#结束切分 单词同时以#结尾
+*          为0时#视为普通字符 单词仅以空白分隔(用于补全)
+*/
+static unsigned int
+tokenize(struct parse_line* line, const char* buf, int comment)
+{
+    unsigned int pos = 0, start;
+    struct parse_span* toks;
+
+    line->buf = buf;
+    line->nb_tok = 0;
+    line->tok_cap = PARSE_TOKEN_MAX;
+    line->truncated = 0;
+    line->trailing_blank = 0;
+    line->toks = line->tok_local;
+
+    while(1)
+    {
+        //跳过空白
+        start = pos;
+        while(isblank(buf[pos]))
+            ++pos;
+        //字符串结束或存在注释符#时停止切分
+        if(!buf[pos] || isendofline(buf[pos]) || (comment && iscomment(buf[pos])))
+            break;
+        //单词数超过预留数量时按2倍扩容 扩容失败时不再记录
+        if(line->nb_tok == line->tok_cap)
+        {
+            if(line->toks == line->tok_local)
+            {
+                toks = malloc(sizeof(*toks) * line->tok_cap * 2);
+                if(toks != NULL)
+                    memcpy(toks, line->tok_local, sizeof(line->tok_local));
+            }
+            else
+            {
+                toks = realloc(line->toks, sizeof(*toks) * line->tok_cap * 2);
+            }
+            if(toks == NULL)
+            {
+                line->truncated = 1;
+                break;
+            }
+            line->toks = toks;
+            line->tok_cap *= 2;
+        }
+        
+        //记录单词
+        line->toks[line->nb_tok].offset = pos;
+        if(comment)
+        {
+            while(!isendoftoken(buf[pos]))
+                ++pos;
+        }
+        else
+        {
+            while(buf[pos] && !isblank(buf[pos]) && !isendofline(buf[pos]))
+                ++pos;
+        }
+        line->toks[line->nb_tok].len = pos - line->toks[line->nb_tok].offset;
+        ++line->nb_tok;
+    }
+    line->trailing_blank = (pos > start);
+
+    return line->nb_tok;
+}
+
+unsigned int
+parse_tokenize(struct parse_line* line, const char* buf)
+{
+    if(!line || !buf)
+        return 0;
+    return tokenize(line, buf, 1);
+}
+
+void
+parse_line_free(struct parse_line* line)
+{
+    if(!line)
+        return;
+    if(line->toks != line->tok_local)
+        free(line->toks);
+    line->toks = line->tok_local;
+    line->tok_cap = PARSE_TOKEN_MAX;
+    line->nb_tok = 0;
+}
+
+/*
+* 尝试对切分后的输入行依照命令inst进行匹配
+* 每个令牌从对应单词的起始位置开始解析
 * 
 *           inst: 比对依照的命令
-*            buf: 需要比对的字符串
+*           line: 需要比对的输入行
 * nb_match_token: 最大匹配令牌数,当其为0时即匹配所有令牌
 *     result_buf: 储存匹配结果的地方 不一定为空
 *
@@ -106,11 +202,13 @@ nb_common_chars(const char* s1, const char* s2)
 * 返回 >0 为匹配成功的令牌数(未完全匹配)
 */
 static int
-match_inst(parse_inst_t* inst, const char* buf, unsigned int nb_match_token, void* result_buf)
+match_inst(parse_inst_t* inst, struct parse_line* line, unsigned int nb_match_token, void* result_buf)
 {
     unsigned int token_num = 0;//当前匹配令牌下标
     parse_token_hdr_t* token_p;//指向匹配中的令牌
     struct token_hdr token_hdr;//正在匹配中的令牌
+    unsigned int t = 0, first;//当前匹配的单词下标
+    unsigned int end;//令牌匹配内容的结尾
     unsigned int i = 0;//匹配成功数
     int n = 0;
 
@@ -122,19 +220,24 @@ match_inst(parse_inst_t* inst, const char* buf, unsigned int nb_match_token, voi
     //开始对令牌进行匹配
     while(token_p && (!nb_match_token || i < nb_match_token)) 
     {
-        //跳过空白
-        while(isblank(*buf)) 
-            buf++;
-        //当字符串结束或存在注释符#时停止匹配
-        if(isendofline(*buf) || iscomment(*buf))
+        //没有剩余单词时停止匹配
+        if(t >= line->nb_tok)
             break;
         
         //使用令牌回调函数parse进行解析
-        n = token_hdr.ops->parse(token_p, buf, (result_buf ? result_buf + token_hdr.offset : NULL));
+        n = token_hdr.ops->parse(token_p, line->buf + line->toks[t].offset,
+                                 (result_buf ? result_buf + token_hdr.offset : NULL));
         if(n < 0)
             break;
+
+        //跳过令牌匹配的单词 匹配内容不能在单词中间结束
+        end = line->toks[t].offset + n;
+        first = t;
+        while(t < line->nb_tok && line->toks[t].offset + line->toks[t].len <= end)
+            ++t;
+        if(t == first || (t < line->nb_tok && line->toks[t].offset < end))
+            break;
         i++;
-        buf += n;
         
         //开始匹配下一个令牌
         ++token_num;
@@ -163,59 +266,430 @@ match_inst(parse_inst_t* inst, const char* buf, unsigned int nb_match_token, voi
         return i;
     }
 
-    //如果字符串还有连续空白就去掉
-    while(isblank(*buf)) 
-    {
-        buf++;
-    }
-    //如果去掉空白就没有内容了则匹配成功
-    if(isendofline(*buf) || iscomment(*buf))
+    //如果没有剩余单词则匹配成功
+    if(t >= line->nb_tok && !line->truncated)
         return 0;
 
     //返回匹配成功的数量
     return i;
 }
 
+/*
+* 比较两个不以'\0'结尾的字符串
+*/
+static int
+index_word_cmp(const char* s1, unsigned int len1, const char* s2, unsigned int len2)
+{
+    int ret;
+
+    ret = memcmp(s1, s2, len1 < len2 ? len1 : len2);
+    if(ret)
+        return ret;
+    if(len1 == len2)
+        return 0;
+    return len1 < len2 ? -1 : 1;
+}
+
+/*
+* 在节点的子节点中二分查找字符串
+* 找到时返回1 pos为其下标
+* 未找到时返回0 pos为其应插入的位置
+*/
+static int
+index_node_find(struct parse_index_node* node, const char* word, unsigned int len, unsigned int* pos)
+{
+    unsigned int low = 0, high = node->nb_children, mid;
+    int ret;
+
+    while(low < high)
+    {
+        mid = (low + high) / 2;
+        ret = index_word_cmp(word, len, node->children[mid]->word, node->children[mid]->word_len);
+        if(ret == 0)
+        {
+            *pos = mid;
+            return 1;
+        }
+        if(ret < 0)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+    *pos = low;
+    return 0;
+}
+
+/*
+* 获取字符串对应的子节点 不存在时新建
+* 返回NULL为失败
+*/
+static struct parse_index_node*
+index_node_get_child(struct parse_index_node* node, const char* word, unsigned int len)
+{
+    struct parse_index_node* child;
+    struct parse_index_node** children;
+    unsigned int pos;
+
+    if(index_node_find(node, word, len, &pos))
+        return node->children[pos];
+
+    if(node->nb_children == node->children_cap)
+    {
+        node->children_cap = node->children_cap ? node->children_cap * 2 : 4;
+        children = realloc(node->children, sizeof(*children) * node->children_cap);
+        if(children == NULL)
+            return NULL;
+        node->children = children;
+    }
+    child = malloc(sizeof(struct parse_index_node));
+    if(child == NULL)
+        return NULL;
+    memset(child, 0, sizeof(struct parse_index_node));
+    child->word = word;
+    child->word_len = len;
+
+    //保持子节点有序
+    memmove(node->children + pos + 1, node->children + pos,
+            sizeof(*children) * (node->nb_children - pos));
+    node->children[pos] = child;
+    ++node->nb_children;
+    return child;
+}
+
+/*
+* 向节点添加命令下标
+* 返回0为成功 -1为失败
+*/
+static int
+index_node_add_inst(struct parse_index_node* node, unsigned int inst_num)
+{
+    unsigned int* insts;
+
+    if(node->nb_insts == node->insts_cap)
+    {
+        node->insts_cap = node->insts_cap ? node->insts_cap * 2 : 4;
+        insts = realloc(node->insts, sizeof(*insts) * node->insts_cap);
+        if(insts == NULL)
+            return -1;
+        node->insts = insts;
+    }
+    node->insts[node->nb_insts++] = inst_num;
+    return 0;
+}
+
+/*
+* 获取固定字符串令牌中可用于索引的选择数
+* 令牌不是固定字符串时返回0
+*/
+static unsigned int
+index_token_nb_words(parse_token_hdr_t* token_p)
+{
+    const struct token_string_table* table;
+
+    if(!token_p || token_p->ops != &token_string_ops)
+        return 0;
+    table = token_string_get_table((struct token_string*)token_p);
+    if(table == NULL)
+        return 0;
+    return table->nb;
+}
+
+/*
+* 将命令插入索引
+* 沿命令开头的固定字符串令牌向下建树 多选字符串的每个选择各自形成路径
+* 
+*     node: 当前节点
+*     inst: 插入的命令
+* inst_num: 命令在命令组中的下标
+*    depth: 当前深度 即已处理的令牌数
+*    paths: 命令当前已有的路径数
+*
+* 返回0为成功 -1为失败
+*/
+static int
+index_insert(struct parse_index_node* node, parse_inst_t* inst, unsigned int inst_num,
+             unsigned int depth, unsigned int paths)
+{
+    parse_token_hdr_t* token_p = inst->tokens[depth];
+    struct parse_index_node* child;
+    const struct token_string_table* table;
+    const struct token_string_elt* elts;
+    unsigned int nb, i;
+
+    //非固定字符串/深度超限/路径数超限 命令停留在此节点
+    nb = index_token_nb_words(token_p);
+    if(nb == 0 || depth >= PARSE_INDEX_MAX_DEPTH || paths * nb > PARSE_INDEX_MAX_PATHS)
+        return index_node_add_inst(node, inst_num);
+
+    //存在无法作为单个单词的选择(包含空白等单词结束符)时 命令停留在此节点 交给match_inst逐项比较
+    table = token_string_get_table((struct token_string*)token_p);
+    if(table->slow)
+        return index_node_add_inst(node, inst_num);
+    elts = table->elts;
+    for(i = 0; i < nb; ++i)
+    {
+        if(elts[i].len == 0 || elts[i].len >= STR_TOKEN_SIZE - 1)
+            return index_node_add_inst(node, inst_num);
+    }
+
+    //每个选择各自形成路径
+    for(i = 0; i < nb; ++i)
+    {
+        child = index_node_get_child(node, elts[i].str, elts[i].len);
+        if(child == NULL || index_insert(child, inst, inst_num, depth + 1, paths * nb) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+* free索引节点的所有子节点及命令下标
+*/
+static void
+index_node_free(struct parse_index_node* node)
+{
+    unsigned int i;
+
+    for(i = 0; i < node->nb_children; ++i)
+    {
+        index_node_free(node->children[i]);
+        free(node->children[i]);
+    }
+    free(node->children);
+    free(node->insts);
+}
+
 int
-parse(struct cmdline* cl, const char* buf)
+parse_inst_result_size(parse_inst_t* inst)
 {
-    if(!cl || !buf)
-        return PARSE_BAD_ARGS;
+    if(!inst)
+        return -1;
+
+    parse_token_hdr_t* token_p;
+    unsigned int i, need, end, size = 0;
+
+    for(i = 0; (token_p = inst->tokens[i]) != NULL; ++i)
+    {
+        //令牌写入的长度
+        need = token_p->size;
+        if(token_p->ops->get_result_size)
+            need = token_p->ops->get_result_size(token_p);
+        
+        //长度未知时与原有的固定缓冲区一致 可使用至PARSE_RESULT_MAX
+        if(need == 0)
+        {
+            if(token_p->offset >= PARSE_RESULT_MAX)
+                return -1;
+            size = PARSE_RESULT_MAX;
+            continue;
+        }
+        //结果字段放不下
+        if(token_p->size && need > token_p->size)
+            return -1;
+        
+        end = token_p->offset + (token_p->size > need ? token_p->size : need);
+        if(end > PARSE_RESULT_MAX)
+            return -1;
+        if(end > size)
+            size = end;
+    }
+    return size;
+}
+
+int
+parse_ctx_result_size(parse_ctx_t* ctx)
+{
+    if(!ctx)
+        return -1;
+
+    unsigned int inst_num;
+    int size, max = 0;
+
+    for(inst_num = 0; ctx[inst_num]; ++inst_num)
+    {
+        size = parse_inst_result_size(ctx[inst_num]);
+        if(size < 0)
+            return -1;
+        if(size > max)
+            max = size;
+    }
+    return max;
+}
+
+struct parse_index*
+parse_index_new(parse_ctx_t* ctx)
+{
+    if(!ctx)
+        return NULL;
+
+    struct parse_index* idx;
+    unsigned int inst_num;
+    int size;
+
+    //命令的解析结果长度有误时无法注册
+    size = parse_ctx_result_size(ctx);
+    if(size < 0)
+        return NULL;
 
+    idx = malloc(sizeof(struct parse_index));
+    if(idx == NULL)
+        return NULL;
+    memset(idx, 0, sizeof(struct parse_index));
+    idx->ctx = ctx;
+    idx->result_size = size;
+    idx->refcnt = 1;
+
+    for(inst_num = 0; ctx[inst_num]; ++inst_num)
+    {
+        if(index_insert(&idx->root, ctx[inst_num], inst_num, 0, 1) < 0)
+        {
+            parse_index_free(idx);
+            return NULL;
+        }
+    }
+    return idx;
+}
+
+struct parse_index*
+parse_index_get(struct parse_index* idx)
+{
+    if(!idx)
+        return NULL;
+    ++idx->refcnt;
+    return idx;
+}
+
+void
+parse_index_free(struct parse_index* idx)
+{
+    if(!idx || --idx->refcnt > 0)
+        return;
+    index_node_free(&idx->root);
+    free(idx);
+}
+
+/*
+* 命令匹配状态 在parse()中对每条候选命令进行累计
+*
+*    f: 完全匹配命令的回调函数
+* data: 完全匹配命令的参数
+*  err: 无完全匹配时的返回值
+*/
+struct parse_match_state
+{
+    void (*f)(struct cmdline*, void*, void*);
+    void* data;
+    int err;
+};
+
+/*
+* 对一条候选命令进行完全匹配 并更新匹配状态
+* 返回-1说明出现命令冲突 应停止匹配
+*/
+static int
+parse_try_inst(parse_inst_t* inst, struct parse_line* line, void* result_buf, struct parse_match_state* st)
+{
+    int tok;
+
+    //match_inst进行完全匹配
+    tok = match_inst(inst, line, 0, result_buf);
+    if(tok > 0)//没有完全匹配
+    {
+        st->err = PARSE_BAD_ARGS;
+    }
+    else if(!tok)//成功 
+    {
+        //设置回调函数
+        if(!st->f) 
+        {
+            memcpy(&st->f, &inst->f, sizeof(st->f));
+            memcpy(&st->data, &inst->data, sizeof(st->data));
+        }
+        //匹配多条: 命令冲突
+        else 
+        {
+            st->err = PARSE_AMBIGUOUS;
+            st->f = NULL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+* 借助命令索引进行匹配
+* 沿前缀树向下 仅对路径上节点中的命令进行匹配
+*
+* 未被访问的子树中的命令已匹配了至少一个令牌 
+* 遍历整个命令组时它们会返回PARSE_BAD_ARGS 此处需保持一致
+*/
+static void
+parse_with_index(struct parse_index* idx, struct parse_line* line, void* result_buf, struct parse_match_state* st)
+{
+    struct parse_index_node* node = &idx->root;
+    struct parse_span* word;
+    unsigned int depth = 0, pos, i;
+    int found;
+
+    while(1)
+    {
+        //匹配此节点中的命令
+        for(i = 0; i < node->nb_insts; ++i)
+        {
+            if(parse_try_inst(idx->ctx[node->insts[i]], line, result_buf, st) < 0)
+                return;
+        }
+        if(node->nb_children == 0)
+            break;
+
+        //下一个单词即为子节点的键
+        found = 0;
+        if(depth < line->nb_tok)
+        {
+            word = &line->toks[depth];
+            found = index_node_find(node, line->buf + word->offset, word->len, &pos);
+        }
+
+        //存在未访问的子树
+        if(depth > 0 && node->nb_children > (unsigned int)found)
+            st->err = PARSE_BAD_ARGS;
+        if(!found)
+            break;
+        node = node->children[pos];
+        ++depth;
+    }
+    //路径末端子树中的命令同样匹配了至少一个令牌
+    if(depth > 0 && node->nb_children > 0)
+        st->err = PARSE_BAD_ARGS;
+}
+
+/*
+* 内部函数 对buf中的命令进行解析
+*
+*         cl: cmdline结构体
+*        buf: 命令字符串
+* result_buf: 解析结果缓冲区 为NULL时仅进行匹配 不调用回调函数
+*/
+static int
+parse_buf(struct cmdline* cl, const char* buf, void* result_buf)
+{
     parse_ctx_t* ctx = cl->cmd_group;//命令组
     unsigned int inst_num = 0;//正在匹配的命令下标
     parse_inst_t* inst;//指向正在匹配的命令
 
-    const char* curbuf;//遍历buf用的字符指针
-    int comment = 0;
     int linelen = 0;//buf的长度
-    int parse_it = 0;//buf中是否存在有效命令 1为存在
+    struct parse_line line;//切分后的buf
     
-    char result_buf[PARSE_RESULT_MAX];//解析结果缓冲区
-    void (*f)(struct cmdline*, void*, void*) = NULL;//匹配成功调用的回调函数
-    void* data = NULL;
-    int tok;
-    int err = PARSE_NOMATCH;
+    struct parse_match_state st;//匹配状态 记录匹配成功调用的回调函数
 
-    //遍历buf统计长度 并查看是否仅存在空白或注释
-    curbuf = buf;
-    while(!isendofline(*curbuf)) 
+    //遍历buf统计长度
+    while(!isendofline(buf[linelen])) 
     {
-        if(*curbuf == '\0') 
+        if(buf[linelen] == '\0') 
         {
             //在一行命令中出现了\0,此命令存在问题
             return 0;
         }
-        if(iscomment(*curbuf))
-        {
-            comment = 1;
-        }
-        if(!isblank(*curbuf) && !comment) 
-        {
-            //不在注释中且不为空白 说明存在有效命令
-            parse_it = 1;
-        }
-        curbuf++;
         linelen++;
     }
 
@@ -225,58 +699,123 @@ parse(struct cmdline* cl, const char* buf)
         linelen++;
     }
 
-    //无效命令
-    if (parse_it == 0) 
+    //切分单词 仅存在空白或注释时为无效命令
+    if(parse_tokenize(&line, buf) == 0) 
     {
+        parse_line_free(&line);
         return linelen;
     }
 
     /* parse it !! */
-    inst = ctx[inst_num];
-    while(inst) 
+    st.f = NULL;
+    st.data = NULL;
+    st.err = PARSE_NOMATCH;
+    if(cl->cmd_index)
     {
-        //match_inst进行完全匹配
-        tok = match_inst(inst, buf, 0, result_buf);
-        if(tok > 0)//没有完全匹配
-        {
-            err = PARSE_BAD_ARGS;
-        }
-        else if(!tok)//成功 
+        //仅匹配索引给出的候选命令
+        parse_with_index(cl->cmd_index, &line, result_buf, &st);
+    }
+    else
+    {
+        inst = ctx[inst_num];
+        while(inst) 
         {
-            //设置回调函数
-            if(!f) 
-            {
-                memcpy(&f, &inst->f, sizeof(f));
-                memcpy(&data, &inst->data, sizeof(data));
-            }
-            //匹配多条: 命令冲突
-            else 
-            {
-                err = PARSE_AMBIGUOUS;
-                f = NULL;
+            if(parse_try_inst(inst, &line, result_buf, &st) < 0)
                 break;
-            }
+            ++inst_num;
+            inst = ctx[inst_num];
         }
-        ++inst_num;
-        inst = ctx[inst_num];
     }
+    parse_line_free(&line);
+
     //调用回调函数
-    if(f) 
+    if(st.f) 
     {
-        f(cl, result_buf, data);
+        if(result_buf)
+            st.f(cl, result_buf, st.data);
     }
     //没有完全匹配
     else 
     {
-        return err;
+        return st.err;
     }
     return linelen;
 }
 
 int
-complete(struct cmdline* cl, const char* buf, int* state, char* dst, unsigned int size)
+parse(struct cmdline* cl, const char* buf)
+{
+    if(!cl || !buf)
+        return PARSE_BAD_ARGS;
+    //解析结果缓冲区由cmdline持有
+    return parse_buf(cl, buf, cl->result_buf);
+}
+
+int
+parse_check(struct cmdline* cl, const char* buf)
+{
+    if(!cl || !buf)
+        return PARSE_BAD_ARGS;
+    return parse_buf(cl, buf, NULL);
+}
+
+/*
+* 内部函数 将一个选择追加至补全结果的arena
+* arena空间不足时设置truncated 不再记录之后的选择
+*/
+static void
+complete_result_add(struct complete_result* res, const char* fmt, ...)
+{
+    va_list ap;
+    int l;
+
+    if(res->truncated)
+        return;
+
+    va_start(ap, fmt);
+    l = vsnprintf(res->arena + res->used, res->arena_size - res->used, fmt, ap);
+    va_end(ap);
+    if(l < 0 || (unsigned int)l >= res->arena_size - res->used)
+    {
+        res->arena[res->used] = '\0';
+        res->truncated = 1;
+        return;
+    }
+    res->used += l + 1;
+    ++res->nb;
+}
+
+void
+complete_result_init(struct complete_result* res, char* arena, unsigned int size)
+{
+    if(!res)
+        return;
+    res->arena = arena;
+    res->arena_size = arena ? size : 0;
+    res->used = 0;
+    res->nb = 0;
+    res->truncated = (res->arena_size == 0);
+    res->completion[0] = '\0';
+}
+
+const char*
+complete_result_next(const struct complete_result* res, const char* prev)
+{
+    if(!res || res->nb == 0)
+        return NULL;
+    if(prev == NULL)
+        return res->arena;
+    
+    prev += strlen(prev) + 1;
+    if(prev >= res->arena + res->used)
+        return NULL;
+    return prev;
+}
+
+int
+complete(struct cmdline* cl, const char* buf, int help, struct complete_result* res)
 {
-    if(!cl || !buf || !state || !dst)
+    if(!cl || !buf || !res)
         return -1;
     
     parse_ctx_t* ctx = cl->cmd_group;//命令组
@@ -285,204 +824,128 @@ complete(struct cmdline* cl, const char* buf, int* state, char* dst, unsigned in
     parse_token_hdr_t* token_p;
     struct token_hdr token_hdr;
     
+    struct parse_line line;//切分后的buf
     int nb_token = 0;//buf中的完整令牌数
-    const char* incomplete_token = buf;
+    const char* incomplete_token;
     unsigned int incomplete_token_len;
     
-    char completion_buf[COMPLETION_BUF_SIZE];
     int completion_len = -1;
-    unsigned int nb_completable;
-    unsigned int nb_non_completable;
+    unsigned int nb_completable = 0;
+    unsigned int nb_non_completable = 0;
     
     char tmpbuf[COMPLETION_BUF_SIZE];
+    char helpbuf[COMPLETION_BUF_SIZE];
     int tmp_len;
     unsigned int i, n;
-    int l;
-    int local_state = 0;
     const char* help_str;
 
+    res->used = 0;
+    res->nb = 0;
+    res->truncated = (res->arena_size == 0);
+    res->completion[0] = '\0';
+
     //统计buf中的完整令牌数 以及确定需要补全的令牌
-    for(i = 0; buf[i]; ++i)
+    //最后一个单词之后没有空白时 其为需要补全的令牌
+    tokenize(&line, buf, 0);
+    if(line.nb_tok > 0 && !line.trailing_blank)
     {
-        if(!isblank(buf[i]) && isblank(buf[i + 1]))
-            ++nb_token;
-        if(isblank(buf[i]) && !isblank(buf[i + 1]))
-            incomplete_token = buf + i + 1;
+        nb_token = line.nb_tok - 1;
+        incomplete_token = buf + line.toks[nb_token].offset;
+        incomplete_token_len = line.toks[nb_token].len;
     }
-    incomplete_token_len = strnlen(incomplete_token, INPUT_BUF_MAX_SIZE);
-
-    //初筛
-    if(*state <= 0)
+    else
     {
-        nb_completable = 0;
-        nb_non_completable = 0;
-        
-        inst = ctx[inst_num];
-        while(inst)
-        {
-            //对完整令牌进行匹配
-            if(nb_token && match_inst(inst, buf, nb_token, NULL))
-                goto next;
-            
-            //匹配成功 -> 获取要补全的令牌
-            token_p = inst->tokens[nb_token];
-            if(token_p)
-                memcpy(&token_hdr, token_p, sizeof(token_hdr));
-            
-            //无法补全
-            if(!token_p || !token_hdr.ops->complete_get_nb || 
-               !token_hdr.ops->complete_get_elt || 
-               (n = token_hdr.ops->complete_get_nb(token_p)) == 0)
-            {
-                nb_non_completable++;
-                goto next;
-            }
-            
-            //对想要补全的令牌进行匹配
-            for(i = 0; i < n; ++i)
-            {
-                if(token_hdr.ops->complete_get_elt(token_p, i, tmpbuf, sizeof(tmpbuf)) < 0)
-                    continue;
-                tmp_len = strnlen(tmpbuf, sizeof(tmpbuf));
-                if(tmp_len < COMPLETION_BUF_SIZE - 1)
-                {
-                    tmpbuf[tmp_len] = ' ';
-                    tmpbuf[tmp_len + 1] = '\0';
-                }
-                //匹配补全令牌
-                if(!strncmp(incomplete_token, tmpbuf, incomplete_token_len))
-                {
-                    if(completion_len == -1)//起始
-                    {
-                        snprintf(completion_buf, sizeof(completion_buf), "%s", tmpbuf + incomplete_token_len);
-                        completion_len = strnlen(tmpbuf + incomplete_token_len, sizeof(tmpbuf) - incomplete_token_len);
-                    }
-                    else
-                    {
-                        completion_len = nb_common_chars(completion_buf, tmpbuf + incomplete_token_len);
-                        completion_buf[completion_len] = '\0';
-                    }
-                    nb_completable++;
-                }
-            }
-            
-        next:
-            ++inst_num;
-            inst = ctx[inst_num];
-        }
-       
-        //无法补全
-        if(nb_completable == 0 && nb_non_completable == 0)
-            return 0;
-        
-        //不需多项选择
-        if(*state == 0 && incomplete_token_len > 0)
-        {
-            //存在可补全内容
-            if(completion_len > 0)
-            {
-                if((unsigned int)completion_len + 1 > size)
-                    return 0;
-                strcpy(dst, completion_buf);
-                return 2;
-            }
-        }
+        nb_token = line.nb_tok;
+        incomplete_token_len = strlen(buf);
+        incomplete_token = buf + incomplete_token_len;
+        incomplete_token_len = 0;
     }
 
-    /*
-    * 进入输出help模式 首先更改state值 
-    * 此处的state值意义变为已处理数量
-    * local_state: 本次遍历处理数量
-    * 
-    * 当local_state < *state时，说明此次已处理
-    * 开始处理下一个
-    */
-    if(*state == -1)
-        *state = 0;
-
-    inst_num = 0;
+    //一次遍历 同时计算公共补全内容并记录所有选择及其help
     inst = ctx[inst_num];
     while(inst)
     {
-        /* we need to redo it */
-        inst = ctx[inst_num];
+        //对完整令牌进行匹配
+        if(nb_token && match_inst(inst, &line, nb_token, NULL))
+            goto next;
         
-        //匹配已完成令牌
-        if(nb_token && match_inst(inst, buf, nb_token, NULL))
-            goto next2;
-       
         //匹配成功 -> 获取要补全的令牌
         token_p = inst->tokens[nb_token];
         if(token_p)
             memcpy(&token_hdr, token_p, sizeof(token_hdr));
+        help_str = inst->help_str ? inst->help_str : "No help";
         
-        //无法补全
-        if(!token_p || !token_hdr.ops->complete_get_nb ||
-           !token_hdr.ops->complete_get_elt ||
+        //无法补全 记录help
+        if(!token_p || !token_hdr.ops->complete_get_nb || 
+           !token_hdr.ops->complete_get_elt || 
            (n = token_hdr.ops->complete_get_nb(token_p)) == 0)
         {
-            if(local_state < *state)
-            {
-                ++local_state;
-                goto next2;
-            }
-            (*state)++;
-            //help str
-            if (token_p && token_hdr.ops->get_help)
+            nb_non_completable++;
+            if(token_p && token_hdr.ops->get_help)
             {
-                token_hdr.ops->get_help(token_p, tmpbuf, sizeof(tmpbuf));
-                help_str = inst->help_str;
-                if (help_str)
-                    snprintf(dst, size, "[%s]: %s", tmpbuf, help_str);
-                else
-                    snprintf(dst, size, "[%s]: No help", tmpbuf);
+                token_hdr.ops->get_help(token_p, helpbuf, sizeof(helpbuf));
+                complete_result_add(res, "[%s]: %s", helpbuf, help_str);
             }
             else
             {
-                snprintf(dst, size, "[RETURN]");
+                complete_result_add(res, "[RETURN]");
             }
-            return 1;
+            goto next;
         }
+
+        //同一令牌的help只需获取一次
+        helpbuf[0] = '\0';
+        if(token_hdr.ops->get_help)
+            token_hdr.ops->get_help(token_p, helpbuf, sizeof(helpbuf));
         
-        //可以补全 有多种选择
+        //对想要补全的令牌进行匹配
         for(i = 0; i < n; ++i)
         {
             if(token_hdr.ops->complete_get_elt(token_p, i, tmpbuf, sizeof(tmpbuf)) < 0)
                 continue;
             tmp_len = strnlen(tmpbuf, sizeof(tmpbuf));
-            if (tmp_len < COMPLETION_BUF_SIZE - 1) 
-            {	
+            if(tmp_len < COMPLETION_BUF_SIZE - 1)
+            {
                 tmpbuf[tmp_len] = ' ';
-                tmpbuf[tmp_len + 1] = 0;
+                tmpbuf[tmp_len + 1] = '\0';
             }
             //匹配补全令牌
-            if(!strncmp(incomplete_token, tmpbuf, incomplete_token_len))
+            if(strncmp(incomplete_token, tmpbuf, incomplete_token_len))
+                continue;
+
+            if(completion_len == -1)//起始
+            {
+                snprintf(res->completion, sizeof(res->completion), "%s", tmpbuf + incomplete_token_len);
+                completion_len = strnlen(tmpbuf + incomplete_token_len, sizeof(tmpbuf) - incomplete_token_len);
+            }
+            else
             {
-                if(local_state < *state)
-                {
-                    ++local_state;
-                    continue;
-                }
-                (*state)++;
-                l = snprintf(dst, size, "%s", tmpbuf);
-                if(l >= 0 && token_hdr.ops->get_help)
-                {
-                    token_hdr.ops->get_help(token_p, tmpbuf, sizeof(tmpbuf));
-                    help_str = inst->help_str;
-                    if(help_str)
-                        snprintf(dst + l, size - l, "[%s]: %s", tmpbuf, help_str);
-                    else
-                        snprintf(dst + l, size - l, "[%s]: No help", tmpbuf);
-                }
-                return 1;
+                completion_len = nb_common_chars(res->completion, tmpbuf + incomplete_token_len);
+                res->completion[completion_len] = '\0';
             }
+            nb_completable++;
+
+            if(token_hdr.ops->get_help)
+                complete_result_add(res, "%s[%s]: %s", tmpbuf, helpbuf, help_str);
+            else
+                complete_result_add(res, "%s", tmpbuf);
         }
         
-    next2:
+    next:
         ++inst_num;
         inst = ctx[inst_num];
     }
+    parse_line_free(&line);
+   
+    //无法补全
+    if(nb_completable == 0 && nb_non_completable == 0)
+        return COMPLETE_FINISHED;
+    
+    //不需多项选择 存在可补全内容
+    if(!help && incomplete_token_len > 0 && completion_len > 0)
+        return COMPLETE_BUFFER;
 
-    return 0;
+    res->completion[0] = '\0';
+    return COMPLETE_AGAIN;
 }
 
@@ -49,19 +49,66 @@ struct cmdline;
 #define offsetof(type, field)  ((size_t) &( ((type*)0)->field) )
 #endif
 
+/*
+* 解析结果结构体的最大长度 超出时命令组无法注册
+*/
 #define PARSE_RESULT_MAX 10240
 #define COMPLETION_BUF_SIZE 64
 
+/*
+* 切分输入行时预留的单词数 单词更多时在堆上扩容
+*/
+#define PARSE_TOKEN_MAX 64
+
+/*
+* 单词在输入行中的位置
+*
+* offset: 单词起始位置
+*    len: 单词长度
+*/
+struct parse_span
+{
+    unsigned int offset;
+    unsigned int len;
+};
+
+/*
+* 切分后的输入行
+* 输入行只切分一次 所有命令的匹配以及补全均基于此结构进行
+*
+*            buf: 输入行
+*         nb_tok: 单词数
+*        tok_cap: toks的容量
+*      truncated: 扩容失败 之后的内容没有记录
+* trailing_blank: 最后一个单词之后存在空白 (用于补全)
+*           toks: 各单词的位置 指向tok_local或malloc的内存
+*      tok_local: 预留的单词位置 单词数不超过PARSE_TOKEN_MAX时无需malloc
+*
+* toks可能指向结构体自身 切分后不能copy此结构体 使用完毕后需调用parse_line_free()
+*/
+struct parse_line
+{
+    const char* buf;
+    unsigned int nb_tok;
+    unsigned int tok_cap;
+    int truncated;
+    int trailing_blank;
+    struct parse_span* toks;
+    struct parse_span tok_local[PARSE_TOKEN_MAX];
+};
+
 /*
 * 令牌前置结构
 * 
 * token_ops: 储存令牌相关的配置
 *    offset: 储存偏移量
+*      size: 结果字段的长度 (sizeof) 为0时表示未知
 */
 struct token_hdr 
 {
     struct token_ops* ops;
     unsigned int offset;
+    unsigned int size;
 };
 typedef struct token_hdr parse_token_hdr_t;
 
@@ -69,7 +116,7 @@ typedef struct token_hdr parse_token_hdr_t;
 * 令牌回调函数配置
 *
 *            parse: 根据传入的const char*进行匹配 结果存入void* 
-*                   -1为失败
+*                   -1为失败 成功时返回匹配的长度 需以单词结尾为止
 *  complete_get_nb: 返回此令牌中可能匹配选择的数量 
 *                   -1为失败
 * complete_get_elt: 将令牌中下标为int的选择存入char*中
@@ -78,6 +125,8 @@ typedef struct token_hdr parse_token_hdr_t;
 *         get_help: 根据令牌中的可匹配情况 将帮助信息存入char* 
 *                   unsigned int为缓冲区最大长度 
 *                   -1为失败
+*  get_result_size: 返回parse最多写入结果的字节数 可为NULL
+*                   为NULL时以令牌前置结构中的size为准
 */
 struct token_ops 
 {
@@ -85,6 +134,7 @@ struct token_ops
     int (*complete_get_nb)(parse_token_hdr_t*);
     int (*complete_get_elt)(parse_token_hdr_t*, int, char*, unsigned int);
     int (*get_help)(parse_token_hdr_t*, char*, unsigned int);
+    unsigned int (*get_result_size)(parse_token_hdr_t*);
 };
 
 /*
@@ -110,6 +160,87 @@ typedef struct inst parse_inst_t;
 */
 typedef parse_inst_t* parse_ctx_t;
 
+/*
+* 命令索引配置宏
+*     PARSE_INDEX_MAX_DEPTH: 索引的最大深度(固定字符串令牌数)
+*     PARSE_INDEX_MAX_PATHS: 单条命令在索引中的最大路径数
+*                            多选字符串令牌会使路径数成倍增长
+*/
+#define PARSE_INDEX_MAX_DEPTH 8
+#define PARSE_INDEX_MAX_PATHS 64
+
+/*
+* 命令索引节点
+* 以命令开头连续的固定字符串令牌(token_string)为键构成前缀树
+*
+*      word: 此节点对应的字符串 指向令牌str内部 不以'\0'结尾
+*  word_len: 字符串长度
+*  children: 子节点 按字符串排序
+*  nb_insts: 固定前缀恰好在此节点结束的命令数
+*     insts: 这些命令在命令组中的下标
+*/
+struct parse_index_node
+{
+    const char* word;
+    unsigned int word_len;
+    struct parse_index_node** children;
+    unsigned int nb_children;
+    unsigned int children_cap;
+    unsigned int* insts;
+    unsigned int nb_insts;
+    unsigned int insts_cap;
+};
+
+/*
+* 命令索引
+* 由命令组一次性编译而来 解析时仅对候选命令进行匹配
+* 首个令牌不是固定字符串的命令储存在根节点 每次解析都会进行匹配
+* 只读使用 可被多个cmdline共享
+*
+*         ctx: 对应的命令组
+*        root: 前缀树根节点
+* result_size: 命令组中最大的解析结果长度
+*      refcnt: 引用计数
+*/
+struct parse_index
+{
+    parse_ctx_t* ctx;
+    struct parse_index_node root;
+    unsigned int result_size;
+    int refcnt;
+};
+
+/*
+* 计算命令的解析结果长度 即所有令牌结果字段结尾的最大值
+* 令牌的结果长度未知时 结果缓冲区按PARSE_RESULT_MAX分配 与原有的固定缓冲区一致
+* 结果字段小于令牌写入的长度/超出PARSE_RESULT_MAX时失败
+*
+* 返回-1为失败
+*/
+int parse_inst_result_size(parse_inst_t* inst);
+
+/*
+* 计算命令组中最大的解析结果长度 任一命令失败时返回-1
+*/
+int parse_ctx_result_size(parse_ctx_t* ctx);
+
+/*
+* 编译命令组 生成命令索引
+* 同时检查所有命令的解析结果长度
+* 返回NULL为失败
+*/
+struct parse_index* parse_index_new(parse_ctx_t* ctx);
+
+/*
+* 增加命令索引的引用计数 用于共享
+*/
+struct parse_index* parse_index_get(struct parse_index* idx);
+
+/*
+* 减少命令索引的引用计数 为0时free
+*/
+void parse_index_free(struct parse_index* idx);
+
 /*
 * 解析结果对应返回值
 */
@@ -120,6 +251,7 @@ typedef parse_inst_t* parse_ctx_t;
 
 /*
 * 对buf中的命令进行解析
+* cmdline存在命令索引时仅匹配候选命令 否则遍历整个命令组
 *
 *  cl: cmdline结构体 读取其命令组cmd_group
 * buf: 命令字符串
@@ -128,6 +260,14 @@ typedef parse_inst_t* parse_ctx_t;
 */
 int parse(struct cmdline* cl, const char* buf);
 
+/*
+* 仅检查buf中的命令能否匹配 不写入解析结果也不调用回调函数
+* 只读取命令组及命令索引 可在多个线程中同时对同一cmdline调用
+*
+* 返回值与parse()相同
+*/
+int parse_check(struct cmdline* cl, const char* buf);
+
 /*
 * 补全结果对应返回值
 */
@@ -135,18 +275,78 @@ int parse(struct cmdline* cl, const char* buf);
 #define COMPLETE_AGAIN      1
 #define COMPLETE_BUFFER     2
 
+/*
+* 补全结果 由complete()一次遍历填充
+* 各选择依次存放在调用者提供的arena中 以'\0'分隔 通过complete_result_next()遍历
+*
+*      arena: 调用者提供的内存
+* arena_size: arena大小
+*       used: arena已使用的长度
+*         nb: 已记录的选择数
+*  truncated: arena空间不足 之后的选择没有记录
+* completion: 可直接补全的内容 返回COMPLETE_BUFFER时有效
+*/
+struct complete_result
+{
+    char* arena;
+    unsigned int arena_size;
+    unsigned int used;
+    unsigned int nb;
+    int truncated;
+    char completion[COMPLETION_BUF_SIZE];
+};
+
+/*
+* 建议的arena初始大小
+* 返回COMPLETE_AGAIN且truncated时 调用者可扩大arena后重新补全以取得所有选择
+*/
+#define COMPLETE_ARENA_SIZE 16384
+
+/*
+* 初始化补全结果
+*
+*   res: 补全结果
+* arena: 储存选择的内存
+*  size: arena大小
+*/
+void complete_result_init(struct complete_result* res, char* arena, unsigned int size);
+
+/*
+* 遍历补全结果中的选择
+* prev为NULL时返回第一个选择 返回NULL时遍历结束
+*/
+const char* complete_result_next(const struct complete_result* res, const char* prev);
+
 /*
 * 对buf中的命令进行补全
+* 所有命令只遍历一次 公共补全内容与所有选择(含help)同时记录至res
 *
-*    cl: cmdline结构体 读取其命令组cmd_group
-*   buf: 命令字符串
-* state: 解析模式 (*state)为0时尝试完成 为-1时仅显示选择
-*   dst: 返回的字符串
-*  size: dst最大长度
+*   cl: cmdline结构体 读取其命令组cmd_group
+*  buf: 命令字符串
+* help: 为0时尝试完成 为1时仅显示选择
+*  res: 补全结果 需先由complete_result_init()初始化
 *
+* COMPLETE_FINISHED: 无法补全
+*   COMPLETE_BUFFER: 存在唯一的补全内容 见res->completion
+*    COMPLETE_AGAIN: 存在多种选择 见res中记录的选择
 * 出错时返回值为负数
 */
-int complete(struct cmdline* cl, const char* buf, int* state, char* dst, unsigned int size);
+int complete(struct cmdline* cl, const char* buf, int help, struct complete_result* res);
+
+/*
+* 将buf切分为单词 以空白分隔 遇到行尾/注释符#/'\0'时结束
+*
+* line: 储存切分结果 line->buf指向buf
+*  buf: 输入行
+*
+* 返回值为单词数
+*/
+unsigned int parse_tokenize(struct parse_line* line, const char* buf);
+
+/*
+* 释放切分输入行时扩容的内存
+*/
+void parse_line_free(struct parse_line* line);
 
 /* true if(!c || iscomment(c) || isblank(c) || isendofline(c)) */
 int isendoftoken(char c);
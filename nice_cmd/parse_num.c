@@ -43,6 +43,7 @@ struct token_ops token_num_ops = {
     .complete_get_nb = NULL,
     .complete_get_elt = NULL,
     .get_help = get_help_num,
+    .get_result_size = get_result_size_num,
 };
 
 enum num_parse_state_t 
@@ -523,3 +524,34 @@ get_help_num(parse_token_hdr_t* tk, char* dstbuf, unsigned int size)
 
 
 
+
+//解析结果长度
+unsigned int
+get_result_size_num(parse_token_hdr_t* tk)
+{
+    if(!tk)
+        return 0;
+
+    //与parse_num中的写入方式一致 INT8/UINT8以int写入
+    switch(((struct token_num*)tk)->num_data.type)
+    {
+        case INT8:
+            return sizeof(int);
+        case UINT8:
+            return sizeof(unsigned int);
+        case INT16:
+            return sizeof(int16_t);
+        case UINT16:
+            return sizeof(uint16_t);
+        case INT32:
+            return sizeof(int32_t);
+        case UINT32:
+            return sizeof(uint32_t);
+#ifndef CONFIG_MODULE_PARSE_NO_FLOAT
+        case FLOAT:
+            return sizeof(float);
+#endif
+        default:
+            return 0;
+    }
+}
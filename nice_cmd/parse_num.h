@@ -92,9 +92,12 @@ extern struct token_ops token_num_ops;
 *
 * get_help_num: 将令牌中的numtype copy至dstbuf中
 *               返回-1为失败 0为成功
+*
+* get_result_size_num: 返回numtype对应的解析结果长度
 */
 int parse_num(parse_token_hdr_t* tk, const char* srcbuf, void* res);
 int get_help_num(parse_token_hdr_t* tk, char* dstbuf, unsigned int size);
+unsigned int get_result_size_num(parse_token_hdr_t* tk);
 
 /*
 * 令牌初始化宏
@@ -104,6 +107,7 @@ int get_help_num(parse_token_hdr_t* tk, char* dstbuf, unsigned int size);
         .hdr = {                                           \
                 .ops = &token_num_ops,                     \
                 .offset = offsetof(structure, field),      \
+                .size = sizeof(((structure*)0)->field),    \
         },                                                 \
         .num_data = {                                      \
                 .type = numtype,                           \
@@ -34,7 +34,9 @@
 
 #include<stdio.h>
 #include<ctype.h>
+#include<stdlib.h>
 #include<string.h>
+#include<pthread.h>
 #include"parse_string.h"
 
 struct token_ops token_string_ops = {
@@ -42,6 +44,7 @@ struct token_ops token_string_ops = {
     .complete_get_nb = complete_get_nb_string,
     .complete_get_elt = complete_get_elt_string,
     .get_help = get_help_string,
+    .get_result_size = get_result_size_string,
 };
 
 #define MULTISTRING_HELP "Mul-choice STRING"
@@ -67,17 +70,92 @@ get_token_len(const char* s)
 }
 
 /*
-* static 获取(令牌)data的下一个内容(由#分隔)
+* 生成选择表时使用的锁 选择表生成后读取无需加锁
 */
-static const char*
-get_next_token(const char* s)
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+* static 选择的比较函数 先比较长度再比较内容
+*/
+static int
+elt_cmp(const void* a, const void* b)
 {
-    unsigned int i;
-    
-    i = get_token_len(s);
-    if(s[i] == '#')
-        return s + i + 1;
-    return NULL;
+    const struct token_string_elt* e1 = a;
+    const struct token_string_elt* e2 = b;
+
+    if(e1->len != e2->len)
+        return e1->len < e2->len ? -1 : 1;
+    return memcmp(e1->str, e2->str, e1->len);
+}
+
+/*
+* static 根据str生成选择表
+* 表头/elts/sorted在同一块内存中 一次free即可
+*/
+static struct token_string_table*
+build_table(const char* str)
+{
+    struct token_string_table* table;
+    const char* s;
+    unsigned int nb = 1, i, j;
+
+    for(s = str; *s; ++s)
+    {
+        if(*s == '#')
+            ++nb;
+    }
+
+    table = malloc(sizeof(struct token_string_table) + 2 * nb * sizeof(struct token_string_elt));
+    if(table == NULL)
+        return NULL;
+    table->nb = nb;
+    table->slow = 0;
+    table->elts = (struct token_string_elt*)(table + 1);
+    table->sorted = table->elts + nb;
+
+    s = str;
+    for(i = 0; i < nb; ++i)
+    {
+        table->elts[i].str = s;
+        table->elts[i].len = get_token_len(s);
+        //选择中含有单词结束符时 无法按单词二分查找
+        for(j = 0; j < table->elts[i].len; ++j)
+        {
+            if(isendoftoken(s[j]))
+                table->slow = 1;
+        }
+        s += table->elts[i].len + 1;
+    }
+    memcpy(table->sorted, table->elts, nb * sizeof(struct token_string_elt));
+    qsort(table->sorted, nb, sizeof(struct token_string_elt), elt_cmp);
+
+    return table;
+}
+
+const struct token_string_table*
+token_string_get_table(struct token_string* tk)
+{
+    if(!tk || !tk->string_data.str)
+        return NULL;
+
+    struct token_string_table* table;
+
+    //双重检查 选择表只生成一次
+    table = __atomic_load_n(&tk->string_data.table, __ATOMIC_ACQUIRE);
+    if(table)
+        return table;
+
+    pthread_mutex_lock(&table_lock);
+    table = tk->string_data.table;
+    if(table == NULL)
+    {
+        table = build_table(tk->string_data.str);
+        if(table)
+            __atomic_store_n(&tk->string_data.table, table, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&table_lock);
+
+    return table;
 }
 
 int
@@ -88,8 +166,9 @@ parse_string(parse_token_hdr_t* tk, const char* buf, void* res)
     
     struct token_string* tk2;
     struct token_string_data* sd;
-    unsigned int token_len;
-    const char* str;
+    const struct token_string_table* table;
+    struct token_string_elt key;
+    unsigned int token_len, i;
 
     tk2 = (struct token_string*)tk;
     sd = &tk2->string_data;
@@ -97,31 +176,40 @@ parse_string(parse_token_hdr_t* tk, const char* buf, void* res)
     //开始匹配
     if(sd->str) 
     {
-        str = (const char*)sd->str;
-        do 
+        table = token_string_get_table(tk2);
+        if(table == NULL)
+            return -1;
+
+        if(table->slow)
         {
-            token_len = get_token_len(str);
-            //长度超限
-            if(token_len >= STR_TOKEN_SIZE - 1) 
+            //逐项比较 选择中可能含有空白
+            for(i = 0; i < table->nb; ++i)
             {
-                continue;
+                token_len = table->elts[i].len;
+                if(token_len < STR_TOKEN_SIZE - 1 &&
+                   strncmp(buf, table->elts[i].str, token_len) == 0 &&
+                   isendoftoken(*(buf + token_len)))
+                    break;
             }
-            //无法匹配
-            if(strncmp(buf, str, token_len)) 
-            {
-                continue;
-            }
-            //传入字符串与令牌str长度不符
-            if(!isendoftoken(*(buf + token_len))) 
-            {
-                continue;
-            }
-            break;
-        }while((str = get_next_token(str)) != NULL);
-        
-        //没有匹配
-        if(!str)
-            return -1;
+            //没有匹配
+            if(i == table->nb)
+                return -1;
+        }
+        else
+        {
+            //取出单词后二分查找
+            token_len = 0;
+            while(!isendoftoken(buf[token_len]) && token_len < (STR_TOKEN_SIZE - 1))
+                ++token_len;
+            //长度超限
+            if(token_len >= STR_TOKEN_SIZE - 1) 
+                return -1;
+            key.str = buf;
+            key.len = token_len;
+            //没有匹配
+            if(!bsearch(&key, table->sorted, table->nb, sizeof(struct token_string_elt), elt_cmp))
+                return -1;
+        }
     }
     //令牌中str为空 -> 直接匹配
     else 
@@ -149,22 +237,16 @@ int complete_get_nb_string(parse_token_hdr_t* tk)
     if(!tk)
         return -1;
 
-    struct token_string* tk2;
-    struct token_string_data* sd;
-    const char* str;
-    int ret = 1;
-
-    tk2 = (struct token_string*)tk;
-    sd = &tk2->string_data;
+    const struct token_string_table* table;
 
-    if(!sd->str)
+    if(!((struct token_string*)tk)->string_data.str)
         return 0;
 
-    str = (const char *)sd->str;
-    while((str = get_next_token(str)) != NULL) 
-        ++ret;
+    table = token_string_get_table((struct token_string*)tk);
+    if(table == NULL)
+        return -1;
     
-    return ret;
+    return table->nb;
 }
 
 int
@@ -173,28 +255,19 @@ complete_get_elt_string(parse_token_hdr_t* tk, int idx, char* dstbuf, unsigned i
     if(!tk || idx < 0 || !dstbuf)
         return -1;
 
-    struct token_string* tk2;
-    struct token_string_data* sd;
-    const char* str;
+    const struct token_string_table* table;
     unsigned int len;
 
-    tk2 = (struct token_string*)tk;
-    sd = &tk2->string_data;
-
-    str = (const char*)sd->str;
-
     //寻找索引为idx的选择
-    while(idx-- && str)
-        str = get_next_token(str);
-
-    if(!str)
+    table = token_string_get_table((struct token_string*)tk);
+    if(table == NULL || (unsigned int)idx >= table->nb)
         return -1;
 
-    len = get_token_len(str);
+    len = table->elts[idx].len;
     if (len > size - 1)
         return -1;
 
-    memcpy(dstbuf, str, len);
+    memcpy(dstbuf, table->elts[idx].str, len);
     dstbuf[len] = '\0';
 
     return 0;
@@ -218,7 +291,7 @@ int get_help_string(parse_token_hdr_t* tk, char* dstbuf, unsigned int size)
     if(str) 
     {
         //多项可能匹配
-        if(get_next_token(str)) 
+        if(strchr(str, '#')) 
         {
             strncpy(dstbuf, MULTISTRING_HELP, size);
         }
@@ -238,3 +311,27 @@ int get_help_string(parse_token_hdr_t* tk, char* dstbuf, unsigned int size)
     return 0;
 }
 
+unsigned int
+get_result_size_string(parse_token_hdr_t* tk)
+{
+    if(!tk)
+        return 0;
+
+    const struct token_string_table* table;
+    unsigned int i, len = 0;
+
+    //任意字符串
+    if(!((struct token_string*)tk)->string_data.str)
+        return STR_TOKEN_SIZE - 1;
+
+    //固定字符串 最长的可匹配选择
+    table = token_string_get_table((struct token_string*)tk);
+    if(table == NULL)
+        return STR_TOKEN_SIZE - 1;
+    for(i = 0; i < table->nb; ++i)
+    {
+        if(table->elts[i].len < STR_TOKEN_SIZE - 1 && table->elts[i].len > len)
+            len = table->elts[i].len;
+    }
+    return len + 1;
+}
@@ -47,12 +47,44 @@ extern "C"
 
 typedef char fixed_string_t[STR_TOKEN_SIZE];
 
+/*
+* 多选字符串中的一个选择
+*
+* str: 选择在令牌str中的起始位置 不以'\0'结尾
+* len: 选择长度
+*/
+struct token_string_elt
+{
+    const char* str;
+    unsigned int len;
+};
+
+/*
+* 令牌str的选择表 首次使用时由str("a#b#c")生成 之后不再重复扫描
+*
+*     nb: 选择数
+*   slow: 存在包含空白等单词结束符的选择 此时匹配需逐项比较
+*   elts: 按声明顺序排列的选择 用于补全(下标即idx)
+* sorted: 按(长度,内容)排序的选择 用于匹配时二分查找
+*/
+struct token_string_table
+{
+    unsigned int nb;
+    int slow;
+    struct token_string_elt* elts;
+    struct token_string_elt* sorted;
+};
+
 /*
 * 令牌data区域
+*
+*   str: 令牌内容 以#分隔多个选择 为NULL时匹配任意字符串
+* table: str的选择表 由token_string_get_table()生成 初始化时为NULL
 */
 struct token_string_data 
 {
     const char* str;
+    struct token_string_table* table;
 };
 
 /*
@@ -80,11 +112,21 @@ extern struct token_ops token_string_ops;
 *  complete_get_nb_string: 返回令牌中可能匹配str数量
 * complete_get_elt_string: 将索引为idx的选择 存入dstbuf
 *         get_help_string: 在dstbuf里存入help类型信息
+*  get_result_size_string: 返回解析结果的最大长度(含'\0')
 */
 int parse_string(parse_token_hdr_t* tk, const char* srcbuf, void* res);
 int complete_get_nb_string(parse_token_hdr_t* tk);
 int complete_get_elt_string(parse_token_hdr_t* tk, int idx, char* dstbuf, unsigned int size);
 int get_help_string(parse_token_hdr_t* tk, char* dstbuf, unsigned int size);
+unsigned int get_result_size_string(parse_token_hdr_t* tk);
+
+/*
+* 获取令牌的选择表 首次调用时生成 线程安全
+* 选择表与令牌生命周期相同 不会被释放
+*
+* 返回NULL为失败(令牌str为空或内存不足)
+*/
+const struct token_string_table* token_string_get_table(struct token_string* tk);
 
 /*
 * 令牌初始化宏
@@ -94,9 +136,11 @@ int get_help_string(parse_token_hdr_t* tk, char* dstbuf, unsigned int size);
         .hdr = {                                            \
                 .ops = &token_string_ops,                   \
                 .offset = offsetof(structure, field),       \
+                .size = sizeof(((structure*)0)->field),     \
         },                                                  \
         .string_data = {                                    \
                 .str = string,                              \
+                .table = NULL,                              \
         },                                                  \
 }
 
@@ -35,6 +35,7 @@
 #include<stdio.h>
 #include<string.h>
 #include<stdint.h>
+#include<pthread.h>
 #include"parser_vt102.h"
 
 /*
@@ -67,96 +68,364 @@ const char *parser_vt102_commands[] = {
     "\020",
     "\016",
     "\033\144",
+    "\022",
+    "\007",
+    vt102_key_home,
+    vt102_key_end,
+    vt102_page_up,
+    vt102_page_down,
+    vt102_insert,
+    vt102_paste_start,
+    vt102_paste_end,
 };
 
+/*
+* 同一按键在不同终端下的其他写法 与parser_vt102_commands[]一同注册
+*/
+static const struct
+{
+    const char* seq;
+    int cmd;
+} parser_vt102_aliases[] = {
+    {"\033OA", CMDLINE_KEY_UP_ARR},
+    {"\033OB", CMDLINE_KEY_DOWN_ARR},
+    {"\033OC", CMDLINE_KEY_RIGHT_ARR},
+    {"\033OD", CMDLINE_KEY_LEFT_ARR},
+    {"\033OH", CMDLINE_KEY_HOME},
+    {"\033[1~", CMDLINE_KEY_HOME},
+    {"\033[7~", CMDLINE_KEY_HOME},
+    {"\033OF", CMDLINE_KEY_END},
+    {"\033[4~", CMDLINE_KEY_END},
+    {"\033[8~", CMDLINE_KEY_END},
+    //ctrl/alt 左右箭头 - 按单词移动
+    {"\033[1;5C", CMDLINE_KEY_WRIGHT},
+    {"\033[1;5D", CMDLINE_KEY_WLEFT},
+    {"\033[1;3C", CMDLINE_KEY_WRIGHT},
+    {"\033[1;3D", CMDLINE_KEY_WLEFT},
+};
+
+/*
+* 按键绑定表的槽位 开放寻址
+*
+* code: 按键事件的编码(参照parser_vt102_key_code()) 0为空槽位
+*  cmd: 对应的CMDLINE_KEY_* -1为已取消绑定
+*/
+struct parser_vt102_slot
+{
+    uint64_t code;
+    int cmd;
+};
+
+signed char parser_vt102_byte_class[256];
+static struct parser_vt102_slot parser_vt102_binds[PARSER_VT102_BIND_SLOTS];
+static unsigned int parser_vt102_nb_binds;
+static pthread_once_t parser_vt102_once = PTHREAD_ONCE_INIT;
+
+/*
+* 内部函数 按键事件的编码 含义相同的写法编码相同
+* 低32位依次为类型/私有标记/中间字符/结束字符 高32位为前两个参数(省略时为1)
+* 之后的参数不为默认值时无法编码 返回0 不与任何按键匹配
+*/
+static uint64_t
+parser_vt102_key_code(const struct parser_vt102_key* key)
+{
+    uint64_t code;
+    unsigned int i;
+
+    if(key->nb_params > PARSER_VT102_PARAM_MAX)
+        return 0;
+    for(i = 2; i < key->nb_params; ++i)
+    {
+        if(PARSER_VT102_KEY_PARAM(key, i) != 1)
+            return 0;
+    }
+
+    code = (uint64_t)key->type | (uint64_t)(uint8_t)key->private_mark << 8 |
+           (uint64_t)(uint8_t)key->intermediate << 16 | (uint64_t)(uint8_t)key->final << 24;
+    if(key->type != PARSER_VT102_KEY_ESC)
+        code |= (uint64_t)PARSER_VT102_KEY_PARAM(key, 0) << 32 | (uint64_t)PARSER_VT102_KEY_PARAM(key, 1) << 48;
+    return code;
+}
+
+/*
+* 内部函数 查找编码所在的槽位 不存在时返回应插入的空槽位
+*/
+static struct parser_vt102_slot*
+parser_vt102_slot(uint64_t code)
+{
+    uint32_t i = (uint32_t)((code * 0x9E3779B97F4A7C15ull) >> 32) & (PARSER_VT102_BIND_SLOTS - 1);
+
+    while(parser_vt102_binds[i].code != 0 && parser_vt102_binds[i].code != code)
+        i = (i + 1) & (PARSER_VT102_BIND_SLOTS - 1);
+    return &parser_vt102_binds[i];
+}
+
+/*
+* 内部函数 控制码结束 查找按键事件对应的按键并重置解析器
+*/
+static int
+parser_vt102_finish(struct parser_vt102* p, int type, char final)
+{
+    struct parser_vt102_slot* slot;
+    uint64_t code;
+
+    p->status = PARSER_VT102_INIT;
+    p->len = 0;
+    p->key.type = type;
+    p->key.final = final;
+
+    if((code = parser_vt102_key_code(&p->key)) == 0)
+        return PARSER_VT102_IGNORED;
+    slot = parser_vt102_slot(code);
+    return slot->code != 0 && slot->cmd >= 0 ? slot->cmd : PARSER_VT102_IGNORED;
+}
+
+/*
+* 内部函数 丢弃当前控制码
+*/
+static int
+parser_vt102_abort(struct parser_vt102* p)
+{
+    p->status = PARSER_VT102_INIT;
+    p->len = 0;
+    return PARSER_VT102_IGNORED;
+}
+
+/*
+* 内部函数 开始新的控制码
+*/
+static int
+parser_vt102_start(struct parser_vt102* p)
+{
+    memset(&p->key, 0, sizeof(p->key));
+    p->status = PARSER_VT102_ESCAPE;
+    p->len = 1;
+    return PARSER_VT102_PENDING;
+}
+
+/*
+* 内部函数 接收CSI/SS3的参数字符(0x30~0x3f)
+* 参数以';'或':'分隔 私有标记只能位于第一个参数之前
+*/
+static void
+parser_vt102_param(struct parser_vt102* p, uint8_t c)
+{
+    struct parser_vt102_key* key = &p->key;
+    unsigned int i, val;
+
+    if(c >= '0' && c <= '9')
+    {
+        if(key->nb_params == 0)
+            key->nb_params = 1;
+        i = key->nb_params - 1;
+        if(i >= PARSER_VT102_PARAM_MAX)
+            return;
+        val = key->params[i] * 10 + (c - '0');
+        key->params[i] = val < PARSER_VT102_PARAM_LIMIT ? val : PARSER_VT102_PARAM_LIMIT;
+    }
+    else if(c == ';' || c == ':')
+    {
+        if(key->nb_params == 0)
+            key->nb_params = 1;
+        ++key->nb_params;
+    }
+    else if(key->nb_params == 0 && key->private_mark == 0)
+    {
+        key->private_mark = c;
+    }
+}
+
+/*
+* 内部函数 对buf中的完整控制码进行解析 不进行初始化
+* buf须恰好为一个按键 返回-1为比对失败
+*/
+static int
+parser_vt102_match(const char* buf, unsigned int size)
+{
+    struct parser_vt102 p;
+    unsigned int i;
+    int ret = PARSER_VT102_PENDING;
+
+    p.status = PARSER_VT102_INIT;
+    p.len = 0;
+    for(i = 0; i < size; ++i)
+    {
+        if(ret != PARSER_VT102_PENDING)
+            return -1;
+        ret = parse_vt102_char(&p, buf[i]);
+    }
+    return ret >= 0 ? ret : -1;
+}
+
+/*
+* 内部函数 注册按键绑定 不进行初始化
+*/
+static int
+parser_vt102_bind_seq(const char* seq, int cmd)
+{
+    struct parser_vt102 p;
+    struct parser_vt102_slot* slot;
+    const uint8_t* s = (const uint8_t*)seq;
+    uint64_t code;
+    int ret = PARSER_VT102_CHAR;
+
+    if(!seq || seq[0] == '\0' || cmd < -1 || cmd > 127)
+        return -1;
+
+    //单字节直接写入分类表 取消绑定时恢复原有分类
+    if(s[1] == '\0')
+    {
+        if(s[0] == 033)
+            return -1;
+        if(cmd >= 0)
+            parser_vt102_byte_class[s[0]] = cmd;
+        else
+            parser_vt102_byte_class[s[0]] = s[0] >= 040 && s[0] < 0177 ? PARSER_VT102_CLASS_PRINT : PARSER_VT102_CLASS_CTRL;
+        return 0;
+    }
+    if(s[0] != 033)
+        return -1;
+
+    //解析为按键事件 序列须恰好在最后一个字符结束
+    p.status = PARSER_VT102_INIT;
+    p.len = 0;
+    for(; *s; ++s)
+    {
+        if(ret != PARSER_VT102_CHAR && ret != PARSER_VT102_PENDING)
+            return -1;
+        ret = parse_vt102_char(&p, *s);
+    }
+    if(ret == PARSER_VT102_PENDING || ret == PARSER_VT102_CHAR || p.key.type == 0)
+        return -1;
+    if((code = parser_vt102_key_code(&p.key)) == 0)
+        return -1;
+
+    slot = parser_vt102_slot(code);
+    if(slot->code == 0)
+    {
+        if(parser_vt102_nb_binds >= PARSER_VT102_BIND_SLOTS / 4 * 3)
+            return -1;
+        ++parser_vt102_nb_binds;
+        slot->code = code;
+    }
+    slot->cmd = cmd;
+    return 0;
+}
+
+/*
+* 内部函数 生成单字节分类表及按键绑定表
+* 同一控制码出现多次时 与逐个比对相同 取下标较小的一个
+*/
+static void
+parser_vt102_build(void)
+{
+    unsigned int i, c;
+
+    for(c = 0; c < 256; ++c)
+        parser_vt102_byte_class[c] = c >= 040 && c < 0177 ? PARSER_VT102_CLASS_PRINT : PARSER_VT102_CLASS_CTRL;
+    parser_vt102_byte_class[033] = PARSER_VT102_CLASS_ESC;
+
+    for(i = 0; i < sizeof(parser_vt102_commands) / sizeof(const char*); ++i)
+    {
+        if(parser_vt102_match(parser_vt102_commands[i], strlen(parser_vt102_commands[i])) < 0)
+            parser_vt102_bind_seq(parser_vt102_commands[i], i);
+    }
+    for(i = 0; i < sizeof(parser_vt102_aliases) / sizeof(parser_vt102_aliases[0]); ++i)
+        parser_vt102_bind_seq(parser_vt102_aliases[i].seq, parser_vt102_aliases[i].cmd);
+}
+
 void
 parser_vt102_init(struct parser_vt102* p)
 {
+    pthread_once(&parser_vt102_once, parser_vt102_build);
     if(!p)
         return;
-    p->buf_pos = 0;
     p->status = PARSER_VT102_INIT;
+    p->len = 0;
+    memset(&p->key, 0, sizeof(p->key));
+}
+
+int
+parser_vt102_bind(const char* seq, int cmd)
+{
+    pthread_once(&parser_vt102_once, parser_vt102_build);
+    return parser_vt102_bind_seq(seq, cmd);
 }
 
 int
 parser_match_command(char* buf, unsigned int size)
 {
-    const char *cmd;
-    unsigned int cmdlen;
-    unsigned int i = 0;
-    
-    //遍历parser_vt102_commands[]比对
-    for(i = 0; i < sizeof(parser_vt102_commands) / sizeof(const char*); ++i) 
-    {
-        cmd = *(parser_vt102_commands + i);
-        cmdlen = strnlen(cmd, PARSER_VT102_BUF_SIZE);
-        if(size == cmdlen && !strncmp(buf, cmd, cmdlen)) 
-        {
-            return i;
-        }
-    }
-    return -1;
+    pthread_once(&parser_vt102_once, parser_vt102_build);
+    if(!buf || size == 0)
+        return -1;
+    return parser_vt102_match(buf, size);
 }
 
 int
 parse_vt102_char(struct parser_vt102* p, char c)
 {
     if(!p)
-        return -1;
+        return PARSER_VT102_CHAR;
     
     uint8_t temp_c = (uint8_t)c;
-    unsigned int size;
+    int cls;
 
-    if(p->buf_pos >= PARSER_VT102_BUF_SIZE) 
+    //单字节查表
+    if(p->status == PARSER_VT102_INIT)
+    {
+        cls = PARSER_VT102_CLASS(temp_c);
+        if(cls == PARSER_VT102_CLASS_ESC)
+            return parser_vt102_start(p);
+        return cls >= 0 ? cls : PARSER_VT102_CHAR;
+    }
+
+    //控制码中的ESC开始新的控制码 原有部分丢弃
+    if(temp_c == 033)
+        return parser_vt102_start(p);
+    //控制码中的其他控制字符 丢弃原有部分后按单字节处理
+    if(temp_c < 040)
     {
         p->status = PARSER_VT102_INIT;
-        p->buf_pos = 0;
+        p->len = 0;
+        cls = PARSER_VT102_CLASS(temp_c);
+        return cls >= 0 ? cls : PARSER_VT102_CHAR;
     }
+    //非7位字符或过长 控制码不合法
+    if(temp_c >= 0200 || ++p->len > PARSER_VT102_SEQ_MAX)
+        return parser_vt102_abort(p);
 
-    //新字符加入解析器缓冲区
-    p->buf[p->buf_pos++] = temp_c;
-    size = p->buf_pos;
-    
-    //根据解析器状态进行控制码比对
+    //根据解析器状态接收控制码
     switch(p->status) 
     {
-        case PARSER_VT102_INIT:
-            if(temp_c == 033) 
-            {
-                p->status = PARSER_VT102_ESCAPE;
-            }
-            else 
-            {
-                p->buf_pos = 0;
-                return parser_match_command(p->buf, size);
-            }
-        break;
-        
         case PARSER_VT102_ESCAPE:
-            if(temp_c == 0133) 
-            {
+            //ESC [ / ESC O
+            if(p->key.intermediate == 0 && temp_c == '[')
                 p->status = PARSER_VT102_ESCAPE_CSI;
-            }
-            else if(temp_c >= 060 && temp_c <= 0177) 
-            {
-                p->buf_pos = 0;
-                p->status = PARSER_VT102_INIT;
-                return parser_match_command(p->buf, size);
-            }
+            else if(p->key.intermediate == 0 && temp_c == 'O')
+                p->status = PARSER_VT102_ESCAPE_SS3;
+            //中间字符
+            else if(temp_c < 060)
+                p->key.intermediate = p->key.intermediate ? p->key.intermediate : (char)temp_c;
+            //ESC + 字符
+            else
+                return parser_vt102_finish(p, PARSER_VT102_KEY_ESC, (char)temp_c);
         break;
         
         case PARSER_VT102_ESCAPE_CSI:
-            if(temp_c >= 0100 && temp_c <= 0176) 
-            {
-                p->buf_pos = 0;
-                p->status = PARSER_VT102_INIT;
-                return parser_match_command(p->buf, size);
-            }
+        case PARSER_VT102_ESCAPE_SS3:
+            //参数
+            if(temp_c >= 060 && temp_c <= 077)
+                parser_vt102_param(p, temp_c);
+            //中间字符
+            else if(temp_c < 060)
+                p->key.intermediate = p->key.intermediate ? p->key.intermediate : (char)temp_c;
+            //结束字符
+            else if(temp_c < 0177)
+                return parser_vt102_finish(p, p->status == PARSER_VT102_ESCAPE_CSI ? PARSER_VT102_KEY_CSI : PARSER_VT102_KEY_SS3, (char)temp_c);
         break;
         
         default:
-            p->buf_pos = 0;
-        break;
+            return parser_vt102_abort(p);
     }
-    return -2;
+    return PARSER_VT102_PENDING;
 }
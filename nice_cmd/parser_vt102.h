@@ -48,6 +48,7 @@ extern "C"
 #define vt102_bs_clear     "\010 \010"
 #define vt102_tab          "\011"
 #define vt102_crnl         "\012\015"
+#define vt102_cr           "\015"
 #define vt102_clear_right  "\033[0K"
 #define vt102_clear_left   "\033[1K"
 #define vt102_clear_down   "\033[0J"
@@ -60,10 +61,21 @@ extern "C"
 #define vt102_left_arr     "\033\133\104"
 #define vt102_multi_right  "\033\133%uC"
 #define vt102_multi_left   "\033\133%uD"
+#define vt102_multi_up     "\033\133%uA"
+#define vt102_multi_down   "\033\133%uB"
 #define vt102_suppr        "\033\133\063\176"
 #define vt102_home         "\033M\033E"
 #define vt102_word_left    "\033\142"
 #define vt102_word_right   "\033\146"
+#define vt102_key_home     "\033\133\110"
+#define vt102_key_end      "\033\133\106"
+#define vt102_page_up      "\033\133\065\176"
+#define vt102_page_down    "\033\133\066\176"
+#define vt102_insert       "\033\133\062\176"
+#define vt102_paste_start  "\033\133\062\060\060\176"
+#define vt102_paste_end    "\033\133\062\060\061\176"
+#define vt102_paste_on     "\033\133\077\062\060\060\064\150"
+#define vt102_paste_off    "\033\133\077\062\060\060\064\154"
 
 /*
 * 可以输入识别的控制码
@@ -98,42 +110,153 @@ extern const char *parser_vt102_commands[];
 #define CMDLINE_KEY_CTRL_P 23
 #define CMDLINE_KEY_CTRL_N 24
 #define CMDLINE_KEY_META_D 25
+#define CMDLINE_KEY_CTRL_R 26
+#define CMDLINE_KEY_CTRL_G 27
+#define CMDLINE_KEY_HOME 28
+#define CMDLINE_KEY_END 29
+#define CMDLINE_KEY_PAGE_UP 30
+#define CMDLINE_KEY_PAGE_DOWN 31
+#define CMDLINE_KEY_INSERT 32
+#define CMDLINE_KEY_PASTE_START 33
+#define CMDLINE_KEY_PASTE_END 34
 
 /*
 * 控制码解析器状态
+*      PARSER_VT102_INIT: 等待新的按键
+*    PARSER_VT102_ESCAPE: 已收到ESC
+* PARSER_VT102_ESCAPE_CSI: 已收到ESC [ 接收参数/中间字符直至结束字符
+* PARSER_VT102_ESCAPE_SS3: 已收到ESC O 下一个字符为结束字符
 */
 enum parser_vt102_status
 {
     PARSER_VT102_INIT,
     PARSER_VT102_ESCAPE,
-    PARSER_VT102_ESCAPE_CSI
+    PARSER_VT102_ESCAPE_CSI,
+    PARSER_VT102_ESCAPE_SS3
 };
 
-#define PARSER_VT102_BUF_SIZE 8
+/*
+* parse_vt102_char()返回值
+*     PARSER_VT102_CHAR: 此字符不是控制码 可以直接对照ASCII处理
+*  PARSER_VT102_PENDING: 此字符是控制码的一部分 且没有结束
+*  PARSER_VT102_IGNORED: 控制码已结束但没有对应的按键 或控制码不合法 整个序列应丢弃
+*/
+#define PARSER_VT102_CHAR    -1
+#define PARSER_VT102_PENDING -2
+#define PARSER_VT102_IGNORED -3
+
+/*
+* 控制码的最大长度 超出时丢弃整个序列
+* 参数的最大个数 超出的参数不记录
+* 单个参数的最大值 超出时取最大值
+*/
+#define PARSER_VT102_SEQ_MAX 32
+#define PARSER_VT102_PARAM_MAX 8
+#define PARSER_VT102_PARAM_LIMIT 65535
+
+/*
+* 单字节分类表 由parser_vt102_commands[]生成 一次查表即可完成分类
+* 表中的值为parser_vt102_commands[]下标 或以下分类之一
+*
+* PARSER_VT102_CLASS_PRINT: 普通可打印字符
+*  PARSER_VT102_CLASS_CTRL: 不对应控制码的不可打印字符
+*   PARSER_VT102_CLASS_ESC: ESC 控制码序列的开始
+*/
+#define PARSER_VT102_CLASS_PRINT -1
+#define PARSER_VT102_CLASS_CTRL  -3
+#define PARSER_VT102_CLASS_ESC   -4
+
+extern signed char parser_vt102_byte_class[256];
+
+/*
+* 字节c的分类 第一次调用parser_vt102_init()之后可用
+*/
+#define PARSER_VT102_CLASS(c) (parser_vt102_byte_class[(unsigned char)(c)])
+
+/*
+* 按键绑定表的槽位数 为2的幂 绑定数不超过其3/4
+*/
+#define PARSER_VT102_BIND_SLOTS 256
+
+/*
+* 按键事件类型
+*  PARSER_VT102_KEY_ESC: ESC + 字符 (alt组合键等)
+*  PARSER_VT102_KEY_CSI: ESC [ 参数 中间字符 结束字符
+*  PARSER_VT102_KEY_SS3: ESC O 结束字符
+*/
+#define PARSER_VT102_KEY_ESC 1
+#define PARSER_VT102_KEY_CSI 2
+#define PARSER_VT102_KEY_SS3 3
+
+/*
+* 按键事件 由ESC开头的控制码解析得到
+* 例如ESC [ 1 ; 5 C (ctrl 右箭头)为type = CSI, params = {1, 5}, final = 'C'
+*
+*         type: PARSER_VT102_KEY_*
+* private_mark: 参数前的私有标记('<' '=' '>' '?') 没有时为0
+* intermediate: 第一个中间字符(0x20~0x2f) 没有时为0
+*        final: 结束字符
+*    nb_params: 参数个数 可能大于PARSER_VT102_PARAM_MAX
+*       params: 参数 省略的参数为0
+*/
+struct parser_vt102_key
+{
+    int type;
+    char private_mark;
+    char intermediate;
+    char final;
+    unsigned int nb_params;
+    unsigned int params[PARSER_VT102_PARAM_MAX];
+};
+
+/*
+* 按键事件的第i个参数 省略或为0时为默认值1(ECMA-48)
+*/
+#define PARSER_VT102_KEY_PARAM(key, i) \
+    ((i) < (key)->nb_params && (i) < PARSER_VT102_PARAM_MAX && (key)->params[i] ? (key)->params[i] : 1)
+
+/*
+* 按键事件的修饰键 xterm的第2个参数 1为无修饰 减1后 bit0为shift bit1为alt bit2为ctrl
+*/
+#define PARSER_VT102_KEY_MOD(key) (PARSER_VT102_KEY_PARAM(key, 1) - 1)
 
 /*
 * 控制码解析器结构体
 * 负责对用户输入的控制码进行解析
 *
-* buf_pos: 缓冲区当前位置
-*     buf: 缓冲区内存
-*  status: 解析器状态
+* status: 解析器状态
+*    len: 当前控制码已接收的长度
+*    key: 当前/最近一次解析的按键事件 控制码结束后保持不变直至下一个控制码
 */
 struct parser_vt102
 {
-    unsigned int buf_pos;
-    char buf[PARSER_VT102_BUF_SIZE];
     enum parser_vt102_status status;
+    unsigned int len;
+    struct parser_vt102_key key;
 };
 
 /*
 * 解析器初始化
+* 第一次调用时由parser_vt102_commands[]生成单字节分类表及按键绑定表
 */
 void parser_vt102_init(struct parser_vt102* p);
 
 /*
-* 对解析器缓冲区内储存的控制码进行比对解析
-* 返回值为-1为比对失败(非控制码)
+* 注册按键绑定 全局生效 需在各命令行开始接收输入之前调用
+* 单字节写入分类表 ESC开头的序列解析为按键事件后写入绑定表
+* 参数不同但含义相同的写法(如ESC [ C与ESC [ 1 ; 1 C)视为同一按键
+* 只比较前两个参数 之后的参数不为默认值的序列无法绑定 输入时也不与任何按键匹配
+*
+* seq: 按键产生的完整控制码 以'\0'结尾
+* cmd: CMDLINE_KEY_* -1为取消绑定(单字节恢复为普通字符 序列被丢弃)
+*
+* 返回0为成功 -1为失败(序列不完整/参数过多/绑定表已满)
+*/
+int parser_vt102_bind(const char* seq, int cmd);
+
+/*
+* 对buf中的完整控制码进行解析
+* 返回值为-1为比对失败(非控制码或没有对应的按键)
 * 其余返回值为parser_vt102_commands[]下标
 */
 int parser_match_command(char* buf, unsigned int size);
@@ -142,9 +265,11 @@ int parser_match_command(char* buf, unsigned int size);
 * 对用户输入的字符进行解析 
 * 匹配是否为控制码
 *
-* 返回值为-1说明此字符不是控制码，可以直接对照ASCII处理
-* 返回值为-2说明此字符是控制码的一部分，且没有结束，不进行处理
+* 返回值为PARSER_VT102_CHAR(-1)说明此字符不是控制码，可以直接对照ASCII处理
+* 返回值为PARSER_VT102_PENDING(-2)说明此字符是控制码的一部分，且没有结束，不进行处理
+* 返回值为PARSER_VT102_IGNORED(-3)说明控制码已结束但没有对应的按键，整个序列应丢弃
 * 其余返回值对应parser_vt102_commands[]的下标，参考宏定义即可
+* 解析得到的按键事件储存在p->key中
 */
 int parse_vt102_char(struct parser_vt102* p, char c);
 
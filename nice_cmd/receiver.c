@@ -33,6 +33,8 @@
  */
 
 #include<stdio.h>
+#include<stdlib.h>
+#include<limits.h>
 #include<errno.h>
 #include<string.h>
 #include<ctype.h>
@@ -43,23 +45,35 @@
 */
 static void receiver_puts(struct receiver* recv, const char* str);
 
-/*
-* 内部函数 输出接收器右部缓冲区
-*/
-static void display_right_buffer(struct receiver* recv, int force);
 
 /* a very very basic printf with one arg and one format 'u' */
 static void receiver_miniprintf(struct receiver* recv, const char* buf, unsigned int val);
 
+/*
+* 内部函数 已从prompt所在行的行首输出pos个字符 更新光标所在行
+*/
+static void receiver_wrap(struct receiver* recv, unsigned int pos);
+
+/*
+* 内部函数 ctrl r历史搜索模式下处理按键
+* 返回1说明搜索结束 按键需继续按普通模式处理
+*/
+static int receiver_search_key(struct receiver* recv, int cmd, char c);
+
+/*
+* 内部函数 显示历史搜索的提示及当前匹配
+*/
+static void receiver_search_display(struct receiver* recv);
+
 int 
 receiver_init(struct receiver* recv, func_write_char* write_char, func_parse_cmd* parse_cmd, func_complete_cmd* complete_cmd)
 {
     if(!recv || !write_char)
         return -EINVAL;
     
-    memset(recv->left, 0, INPUT_BUF_MAX_SIZE);
-    memset(recv->right, 0, INPUT_BUF_MAX_SIZE);
     memset(recv, 0, sizeof(*recv));
+    //缓冲区在输入时才分配
+    gapbuf_init(&recv->line_buf, INPUT_BUF_MAX_SIZE);
 
     //初始化历史记录系统 储存上限为HISTORY_MAX_NUM条
     history_init(&recv->hist, HISTORY_MAX_NUM, INPUT_BUF_MAX_SIZE);
@@ -72,6 +86,39 @@ receiver_init(struct receiver* recv, func_write_char* write_char, func_parse_cmd
     return 0;
 }
 
+int
+receiver_set_line_max(struct receiver* recv, unsigned int max)
+{
+    if(!recv || max > INT_MAX - 2)
+        return -EINVAL;
+    if(gapbuf_set_max(&recv->line_buf, max) < 0)
+        return -EINVAL;
+    history_set_max_size(&recv->hist, max);
+    return 0;
+}
+
+void
+receiver_free(struct receiver* recv)
+{
+    if(!recv)
+        return;
+
+    gapbuf_free(&recv->line_buf);
+    free(recv->paste);
+    recv->paste = NULL;
+    recv->paste_len = 0;
+    recv->paste_cap = 0;
+    free(recv->search_buf);
+    recv->search_buf = NULL;
+    recv->search_len = 0;
+    recv->search_cap = 0;
+    free(recv->shadow);
+    recv->shadow = NULL;
+    recv->shadow_len = 0;
+    recv->shadow_cap = 0;
+    history_free(&recv->hist);
+}
+
 int 
 receiver_new_cmdline(struct receiver* recv, const char* prompt)
 {
@@ -80,24 +127,42 @@ receiver_new_cmdline(struct receiver* recv, const char* prompt)
     
     unsigned int i;
     
-    //重置缓冲区 控制码解析器/左右缓冲
+    //重置缓冲区 控制码解析器/输入缓冲区
     parser_vt102_init(&recv->vt102);
-    inputbuf_init(&recv->left_buf, recv->left, INPUT_BUF_MAX_SIZE);
-    inputbuf_init(&recv->right_buf, recv->right, INPUT_BUF_MAX_SIZE);
+    gapbuf_clear(&recv->line_buf);
+    recv->search_mode = 0;
 
     //输出prompt
-    recv->prompt_size = strnlen(prompt, INPUT_BUF_MAX_SIZE - 1);
+    recv->prompt_size = strnlen(prompt, PROMPT_MAX_SIZE - 1);
     if(prompt != recv->prompt)
         memcpy(recv->prompt, prompt, recv->prompt_size);
-    recv->prompt[INPUT_BUF_MAX_SIZE - 1] = '\0';
+    recv->prompt[recv->prompt_size] = '\0';
     for(i = 0; i < recv->prompt_size; ++i)
         recv->write_char(recv, recv->prompt[i]);
+    receiver_wrap(recv, recv->prompt_size);
+    recv->shadow_len = 0;
+    recv->shadow_pos = 0;
+    recv->shadow_valid = 1;
     
     recv->status = RECEIVER_RUNNING;
     
     return 0;
 }
 
+void
+receiver_set_width(struct receiver* recv, unsigned int cols)
+{
+    if(!recv || recv->cols == cols)
+        return;
+
+    recv->cols = cols;
+    if(recv->status != RECEIVER_RUNNING || recv->search_mode)
+        return;
+    //终端可能按新宽度重新排列了已显示的内容 按新宽度推算光标所在行后重新显示
+    recv->screen_row = cols ? (recv->prompt_size + recv->shadow_pos) / cols : 0;
+    receiver_redisplay(recv);
+}
+
 void 
 receiver_quit(struct receiver* recv)
 {
@@ -112,39 +177,255 @@ receiver_combi_cmd(struct receiver* recv, int mode)
     if(!recv)
         return NULL;
 
-    struct inputbuf* left = &recv->left_buf;
-    struct inputbuf* right = &recv->right_buf;
-    char* all = recv->all_cmd;
-    
-    int l_len, r_len, i, now = 0;
-    char c;
+    //间隙缓冲区的内容本身连续 只需移动间隙
+    if(mode == 0)
+        return gapbuf_line(&recv->line_buf, 1);
+    return gapbuf_left(&recv->line_buf);
+}
 
-    l_len = recv->left_buf.len;
-    r_len = recv->right_buf.len;
+/*
+* 内部函数 保证buf至少可容纳need个字符 按2倍扩容
+* 返回0为成功 -1为失败
+*/
+static int
+receiver_reserve(char** buf, unsigned int* cap, unsigned int need)
+{
+    unsigned int size = *cap ? *cap : GAPBUF_INIT_SIZE;
+    char* tmp;
+
+    if(need <= *cap)
+        return 0;
+    while(size < need)
+        size *= 2;
+    tmp = realloc(*buf, size);
+    if(tmp == NULL)
+        return -1;
+    *buf = tmp;
+    *cap = size;
+    return 0;
+}
 
-    //合并左缓冲区
-    INPUTBUF_FOREACH(left, i, c)
+/*
+* 内部函数 将输入缓冲区中从第from个字符开始的n个字符copy至粘贴缓冲区
+* 扩容失败时粘贴缓冲区为空
+*/
+static void
+receiver_cut(struct receiver* recv, unsigned int from, unsigned int n)
+{
+    if(receiver_reserve(&recv->paste, &recv->paste_cap, n) < 0)
     {
-        all[now] = c;
-        ++now;
+        recv->paste_len = 0;
+        return;
     }
+    recv->paste_len = gapbuf_copy(&recv->line_buf, from, n, recv->paste);
+}
 
-    if(mode == 0)
+/*
+* 内部函数 括号粘贴中的按键处理
+* 返回1为需按普通模式继续处理(逐行执行时的换行) 返回0为已处理
+*/
+static int
+receiver_paste_key(struct receiver* recv, int cmd, char c)
+{
+    int cr = recv->paste_cr;
+
+    recv->paste_cr = 0;
+    switch(cmd)
+    {
+        //粘贴开始
+        case CMDLINE_KEY_PASTE_START:
+            recv->pasting = 1;
+        return 0;
+
+        //粘贴结束 刷新一次显示
+        case CMDLINE_KEY_PASTE_END:
+            recv->pasting = 0;
+            receiver_refresh(recv);
+        return 0;
+    }
+
+    //"\r\n"视为一个换行
+    if(c == '\n' && cr)
+        return 0;
+    if(c == '\r' || c == '\n')
     {
-        //合并右缓冲区
-        INPUTBUF_FOREACH(right, i, c)
+        recv->paste_cr = c == '\r';
+        if(recv->paste_mode != RECEIVER_PASTE_EXEC)
         {
-            all[now] = c;
-            ++now;
-        } 
-        all[l_len + r_len] = '\n';
-	    all[l_len + r_len + 1] = '\0';
-        return all;
+            gapbuf_insert(&recv->line_buf, " ", 1);
+            return 0;
+        }
+        //执行前刷新显示
+        receiver_refresh(recv);
+        return 1;
     }
+    //tab不进行补全
+    if(c == '\t')
+        c = ' ';
+    //其余不可打印字符丢弃
+    if(c >= 040 && c < 0177)
+        gapbuf_insert(&recv->line_buf, &c, 1);
+    return 0;
+}
 
-    //收尾
-    all[l_len] = '\0';
-    return all;
+/*
+* 内部函数 将输入缓冲区替换为str 用于查询历史记录
+*/
+static void
+receiver_load_line(struct receiver* recv, const char* str)
+{
+    parser_vt102_init(&recv->vt102);
+    gapbuf_clear(&recv->line_buf);
+    gapbuf_insert(&recv->line_buf, str, strlen(str));
+    receiver_refresh(recv);
+}
+
+/*
+* 内部函数 光标左侧第一个词的起点
+*/
+static unsigned int
+receiver_word_left(struct receiver* recv)
+{
+    struct gapbuf* line = &recv->line_buf;
+    unsigned int i = line->pos;
+
+    while(i > 0 && isblank(GAPBUF_AT(line, i - 1)))
+        --i;
+    while(i > 0 && !isblank(GAPBUF_AT(line, i - 1)))
+        --i;
+    return i;
+}
+
+/*
+* 内部函数 光标右侧第一个词的终点
+*/
+static unsigned int
+receiver_word_right(struct receiver* recv)
+{
+    struct gapbuf* line = &recv->line_buf;
+    unsigned int i = line->pos;
+
+    while(i < line->len && isblank(GAPBUF_AT(line, i)))
+        ++i;
+    while(i < line->len && !isblank(GAPBUF_AT(line, i)))
+        ++i;
+    return i;
+}
+
+/*
+* 内部函数 屏幕上第col列(prompt之后)所在的行 即与prompt所在行之间的行数
+*/
+static unsigned int
+receiver_row_of(struct receiver* recv, unsigned int col)
+{
+    return recv->cols ? (recv->prompt_size + col) / recv->cols : 0;
+}
+
+/*
+* 内部函数 光标在行内向左移动n列 较近时输出退格
+*/
+static void
+receiver_cursor_back(struct receiver* recv, unsigned int n)
+{
+    if(n <= 3)
+        while(n--)
+            recv->write_char(recv, '\b');
+    else
+        receiver_miniprintf(recv, vt102_multi_left, n);
+}
+
+/*
+* 内部函数 将屏幕上的光标移动至第col列(prompt之后)
+* 命令行分多行显示时 先上下移动至目标行 再在行内移动
+* 行内较近时向左输出退格 向右重新输出屏幕上已有的字符 否则输出多列移动的控制码
+*/
+static void
+receiver_cursor_to(struct receiver* recv, unsigned int col)
+{
+    unsigned int n, row, from, to;
+
+    row = receiver_row_of(recv, col);
+    if(row != recv->screen_row)
+    {
+        if(row < recv->screen_row)
+            receiver_miniprintf(recv, vt102_multi_up, recv->screen_row - row);
+        else
+            receiver_miniprintf(recv, vt102_multi_down, row - recv->screen_row);
+        recv->screen_row = row;
+
+        //上下移动不改变光标所在的终端列
+        from = (recv->prompt_size + recv->shadow_pos) % recv->cols;
+        to = (recv->prompt_size + col) % recv->cols;
+        if(to == 0 && from > 0)
+            receiver_puts(recv, vt102_cr);
+        else if(to < from)
+            receiver_cursor_back(recv, from - to);
+        else if(to > from)
+            receiver_miniprintf(recv, vt102_multi_right, to - from);
+        recv->shadow_pos = col;
+        return;
+    }
+
+    if(col < recv->shadow_pos)
+    {
+        receiver_cursor_back(recv, recv->shadow_pos - col);
+    }
+    else if(col > recv->shadow_pos)
+    {
+        n = col - recv->shadow_pos;
+        if(n <= 3 && recv->shadow_valid && col <= recv->shadow_len)
+            while(n--)
+                recv->write_char(recv, recv->shadow[col - n - 1]);
+        else
+            receiver_miniprintf(recv, vt102_multi_right, n);
+    }
+    recv->shadow_pos = col;
+}
+
+/*
+* 内部函数 在屏幕上的第from列(光标需位于此处)输出输入缓冲区中从第from个字符开始的n个字符
+* 同时更新shadow 扩容失败时shadow不再与屏幕一致
+*/
+static void
+receiver_emit(struct receiver* recv, unsigned int from, unsigned int n)
+{
+    unsigned int i;
+
+    if(recv->shadow_valid && receiver_reserve(&recv->shadow, &recv->shadow_cap, from + n) == 0)
+    {
+        gapbuf_copy(&recv->line_buf, from, n, recv->shadow + from);
+        for(i = 0; i < n; ++i)
+            recv->write_char(recv, recv->shadow[from + i]);
+    }
+    else
+    {
+        recv->shadow_valid = 0;
+        for(i = 0; i < n; ++i)
+            recv->write_char(recv, GAPBUF_AT(&recv->line_buf, from + i));
+    }
+    recv->shadow_pos = from + n;
+    if(recv->shadow_len < from + n)
+        recv->shadow_len = from + n;
+    if(n > 0)
+        receiver_wrap(recv, recv->prompt_size + from + n);
+}
+
+/*
+* 内部函数 光标移动至命令行显示内容的最后一行 之后输出的换行不会覆盖命令行
+*/
+static void
+receiver_cursor_last_row(struct receiver* recv)
+{
+    unsigned int end = recv->prompt_size + recv->shadow_len, row;
+
+    if(!recv->cols)
+        return;
+    row = (end > 0 ? end - 1 : 0) / recv->cols;
+    if(row > recv->screen_row)
+    {
+        receiver_miniprintf(recv, vt102_multi_down, row - recv->screen_row);
+        recv->screen_row = row;
+    }
 }
 
 int
@@ -158,14 +439,22 @@ receiver_parse_char(struct receiver* recv, char c)
         return RECEIVER_RES_NOT_RUNNING;
 
     int cmd;
-    char temp_char;
     unsigned int i;
-    char* temp_str;
+    const char* temp_str;
+    struct gapbuf* line = &recv->line_buf;
 
     cmd = parse_vt102_char(&recv->vt102, c);
 
-    //字符c为控制码的一部分且没有结束
-    if(cmd == -2)
+    //字符c为控制码的一部分且没有结束 或控制码没有对应的按键而被丢弃
+    if(cmd == PARSER_VT102_PENDING || cmd == PARSER_VT102_IGNORED)
+        return RECEIVER_RES_SUCCESS;
+
+    //历史搜索模式 结束搜索的按键继续按普通模式处理
+    if(recv->search_mode && !receiver_search_key(recv, cmd, c))
+        return RECEIVER_RES_SUCCESS;
+
+    //括号粘贴
+    if((recv->pasting || cmd == CMDLINE_KEY_PASTE_START) && !receiver_paste_key(recv, cmd, c))
         return RECEIVER_RES_SUCCESS;
     
     //字符c组成了完整的控制码
@@ -173,160 +462,120 @@ receiver_parse_char(struct receiver* recv, char c)
     {
         switch(cmd)
         {
+            //上箭头 - 查询以光标左侧内容开头的上一条历史记录
             //ctrl p - 历史记录向上
             case CMDLINE_KEY_UP_ARR:
             case CMDLINE_KEY_CTRL_P:
-                if((temp_str = history_get_prev(&recv->hist)) != NULL)
+                //如果当前为用户输入 则需进行记录 光标左侧的内容作为前缀
+                //同时读入其他会话的新命令
+                if(IS_NOT_HISTORY_CMD(&recv->hist))
                 {
-                    //如果当前为用户输入 则需进行记录
-                    if(IS_NOT_HISTORY_CMD(&recv->hist))
-                    {
-                        receiver_combi_cmd(recv, 0);
-                        history_save_user_input(&recv->hist, recv->all_cmd);
-                    }
-                    //清空输入缓冲区
-                    parser_vt102_init(&recv->vt102);
-                    inputbuf_init(&recv->left_buf, recv->left, INPUT_BUF_MAX_SIZE);
-                    inputbuf_init(&recv->right_buf, recv->right, INPUT_BUF_MAX_SIZE);
-                    //写入历史记录
-                    for(i = 0; temp_str[i] != '\0'; ++i)
-                    {
-                        inputbuf_add_tail(&recv->left_buf, temp_str[i]);
-                    }
-                    receiver_redisplay(recv);
+                    history_sync_shared(&recv->hist);
+                    history_save_user_input(&recv->hist, receiver_combi_cmd(recv, 0));
+                    recv->hist_prefix = cmd == CMDLINE_KEY_UP_ARR ? (int)GAPBUF_LEFT_LEN(line) : 0;
+                    if(recv->hist_prefix > recv->hist.user_input_buf_len)
+                        recv->hist_prefix = recv->hist.user_input_buf_len;
                 }
+                if(cmd == CMDLINE_KEY_UP_ARR)
+                    temp_str = history_get_prev_prefix(&recv->hist, recv->hist.user_input_buf, recv->hist_prefix);
+                else
+                    temp_str = history_get_prev(&recv->hist);
+                if(temp_str != NULL)
+                    receiver_load_line(recv, temp_str);
             break;
             
+            //下箭头 - 查询以相同前缀开头的下一条历史记录
             //ctrl n - 历史记录向下
             case CMDLINE_KEY_DOWN_ARR:
             case CMDLINE_KEY_CTRL_N:
-                if((temp_str = history_get_next(&recv->hist)) != NULL)
-                {
-                    //清空输入缓冲区
-                    parser_vt102_init(&recv->vt102);
-                    inputbuf_init(&recv->left_buf, recv->left, INPUT_BUF_MAX_SIZE);
-                    inputbuf_init(&recv->right_buf, recv->right, INPUT_BUF_MAX_SIZE);
-                    //写入历史记录
-                    for(i = 0; temp_str[i] != '\0'; ++i)
-                    {
-                        inputbuf_add_tail(&recv->left_buf, temp_str[i]);
-                    }
-                    receiver_redisplay(recv);
-                }
+                if(cmd == CMDLINE_KEY_DOWN_ARR)
+                    temp_str = history_get_next_prefix(&recv->hist, recv->hist.user_input_buf, recv->hist_prefix);
+                else
+                    temp_str = history_get_next(&recv->hist);
+                if(temp_str != NULL)
+                    receiver_load_line(recv, temp_str);
             break;
             
             //ctrl f - 光标向右
             case CMDLINE_KEY_RIGHT_ARR:
             case CMDLINE_KEY_CTRL_F:
-                if(INPUT_BUF_IS_EMPTY(&recv->right_buf))
+                if(GAPBUF_RIGHT_LEN(line) == 0)
                     break;
-                temp_char = inputbuf_get_head(&recv->right_buf);
-                inputbuf_del_head(&recv->right_buf);
-                inputbuf_add_tail(&recv->left_buf, temp_char);
-                receiver_puts(recv, vt102_right_arr);
-                //printf("\n");
-                //receiver_redisplay(recv);
+                gapbuf_set_pos(line, line->pos + 1);
+                receiver_refresh(recv);
             break;
             
             //ctrl b - 光标向左
             case CMDLINE_KEY_LEFT_ARR:
             case CMDLINE_KEY_CTRL_B:
-                if(INPUT_BUF_IS_EMPTY(&recv->left_buf))
+                if(GAPBUF_LEFT_LEN(line) == 0)
                     break;
-                temp_char = inputbuf_get_tail(&recv->left_buf);
-                inputbuf_del_tail(&recv->left_buf);
-                inputbuf_add_head(&recv->right_buf, temp_char);
-                receiver_puts(recv, vt102_left_arr);
-                //printf("\n");
-                //receiver_redisplay(recv);
+                gapbuf_set_pos(line, line->pos - 1);
+                receiver_refresh(recv);
             break;
             
             //退格 - 删除光标左侧的第一个字符
             case CMDLINE_KEY_BKSPACE:
-                if(INPUT_BUF_IS_EMPTY(&recv->left_buf))
+                if(gapbuf_del_left(line, 1) == 0)
                     break;
-                inputbuf_del_tail(&recv->left_buf);
-                receiver_puts(recv, vt102_bs);
-                display_right_buffer(recv, 1);
+                receiver_refresh(recv);
             break;
             
             //回车 - 执行命令
             case CMDLINE_KEY_RETURN:
             case CMDLINE_KEY_RETURN2:
-                receiver_combi_cmd(recv, 0);
+                temp_str = receiver_combi_cmd(recv, 0);
                 recv->status = RECEIVER_INIT;
+                receiver_cursor_last_row(recv);
                 receiver_puts(recv, "\r\n");
                 if(recv->parse_cmd)
                 {
                     //新命令长度大于0时进行记录
-                    cmd = strnlen(recv->all_cmd, INPUT_BUF_MAX_SIZE * 2) - 1;
-                    if(cmd > 0)
+                    if(line->len > 0)
                     {
-                        history_add_new(&recv->hist, recv->all_cmd, cmd, 0);
+                        history_add_new(&recv->hist, temp_str, line->len, 0);
                     }
                     //解析
-                    recv->parse_cmd(recv, recv->all_cmd);
+                    recv->parse_cmd(recv, temp_str);
                 }
                 if(recv->status == RECEIVER_EXITED)
                     return RECEIVER_RES_EXITED;
                 return RECEIVER_RES_PARSED;
             break;
             
-            //ctrl a - 移动光标至最左
+            //ctrl a / home - 移动光标至最左
             case CMDLINE_KEY_CTRL_A:
-                if(INPUT_BUF_IS_EMPTY(&recv->left_buf))
-                    break;
-                receiver_miniprintf(recv, vt102_multi_left, recv->left_buf.len);
-                while(!INPUT_BUF_IS_EMPTY(&recv->left_buf)) 
-                {
-                    temp_char = inputbuf_get_tail(&recv->left_buf);
-                    inputbuf_del_tail(&recv->left_buf);
-                    inputbuf_add_head(&recv->right_buf, temp_char);
-                }
+            case CMDLINE_KEY_HOME:
+                gapbuf_set_pos(line, 0);
+                receiver_refresh(recv);
             break;
             
-            //ctrl e - 移动光标至最右
+            //ctrl e / end - 移动光标至最右
             case CMDLINE_KEY_CTRL_E:
-                if(INPUT_BUF_IS_EMPTY(&recv->right_buf))
-                    break;
-                receiver_miniprintf(recv, vt102_multi_right, recv->right_buf.len);
-                while(!INPUT_BUF_IS_EMPTY(&recv->right_buf)) 
-                {
-                    temp_char = inputbuf_get_head(&recv->right_buf);
-                    inputbuf_del_head(&recv->right_buf);
-                    inputbuf_add_tail(&recv->left_buf, temp_char);
-                }
+            case CMDLINE_KEY_END:
+                gapbuf_set_pos(line, line->len);
+                receiver_refresh(recv);
             break;
             
             //ctrl k - 剪切光标右侧的内容
             case CMDLINE_KEY_CTRL_K:
-                if(INPUT_BUF_IS_EMPTY(&recv->right_buf))
+                if(GAPBUF_RIGHT_LEN(line) == 0)
                     break;
-                inputbuf_init(&recv->paste_buf, recv->paste, INPUT_BUF_MAX_SIZE * 2);
-                INPUTBUF_FOREACH(&recv->right_buf, i, temp_char)
-                {
-                    inputbuf_add_tail(&recv->paste_buf, temp_char);
-                }
-                inputbuf_init(&recv->right_buf, recv->right, INPUT_BUF_MAX_SIZE);
-                receiver_puts(recv, vt102_clear_right);
+                receiver_cut(recv, line->pos, GAPBUF_RIGHT_LEN(line));
+                gapbuf_del_right(line, GAPBUF_RIGHT_LEN(line));
+                receiver_refresh(recv);
             break;
             
             //ctrl y - 粘贴剪切的内容
             case CMDLINE_KEY_CTRL_Y:
-                if(INPUT_BUF_IS_EMPTY(&recv->paste_buf))
+                if(gapbuf_insert(line, recv->paste, recv->paste_len) == 0)
                     break;
-                INPUTBUF_FOREACH(&recv->paste_buf, i, temp_char)
-                {
-                    if(recv->left_buf.len >= INPUT_BUF_MAX_SIZE - 1)
-                        break;
-                    inputbuf_add_tail(&recv->left_buf, temp_char);
-                    recv->write_char(recv, temp_char);
-                }
-                display_right_buffer(recv, 0);
+                receiver_refresh(recv);
             break;
             
             //ctrl c - 重置命令行
             case CMDLINE_KEY_CTRL_C:
+                receiver_cursor_last_row(recv);
                 receiver_puts(recv, "\r\n");
                 receiver_new_cmdline(recv, recv->prompt);
             break;
@@ -334,17 +583,14 @@ receiver_parse_char(struct receiver* recv, char c)
             //delete / ctrl d - 删除光标右侧的第一个字符
             case CMDLINE_KEY_SUPPR:
             case CMDLINE_KEY_CTRL_D:
-                if(cmd == CMDLINE_KEY_CTRL_D && 
-                    INPUT_BUF_IS_EMPTY(&recv->left_buf) &&
-                    INPUT_BUF_IS_EMPTY(&recv->right_buf)) 
+                if(cmd == CMDLINE_KEY_CTRL_D && GAPBUF_IS_EMPTY(line)) 
                 {
                     return RECEIVER_RES_EOF;
                 }
                 
-                if(INPUT_BUF_IS_EMPTY(&recv->right_buf))
+                if(gapbuf_del_right(line, 1) == 0)
                     break;
-                inputbuf_del_head(&recv->right_buf);    
-                display_right_buffer(recv, 1);
+                receiver_refresh(recv);
             break;
             
             //tab - 尝试补全命令
@@ -352,57 +598,51 @@ receiver_parse_char(struct receiver* recv, char c)
             case CMDLINE_KEY_HELP:
                 if(recv->complete_cmd) 
                 {
-                    char tmp_buf[BUFSIZ];
-                    unsigned int tmp_size;
-                    int complete_state;
-                    int ret;
+                    char* arena = NULL;
+                    char* tmp;
+                    unsigned int size = COMPLETE_ARENA_SIZE;
+                    struct complete_result res;
+                    const char* entry;
+                    int ret = -1;
                    
-                    //将左缓冲区copy至all_cmd 
-                    receiver_combi_cmd(recv, 1);
-                    
-                    //确定是补全还是help
-                    if(cmd == CMDLINE_KEY_TAB)
-                        complete_state = 0;
-                    else
-                        complete_state = -1;
-                    
-                    //初次complete
-                    ret = recv->complete_cmd(recv, recv->all_cmd, &complete_state, tmp_buf, sizeof(tmp_buf));
-                    
-                    //无法补全 or 出错
-                    if(ret <= 0) 
+                    //一次complete取得补全内容及所有可能性 ?时仅显示选择
+                    //arena(malloc)不足以记录所有选择时 按2倍扩容后重新补全
+                    while((tmp = realloc(arena, size)) != NULL)
                     {
-                        return RECEIVER_RES_COMPLETE;
+                        arena = tmp;
+                        complete_result_init(&res, arena, size);
+                        ret = recv->complete_cmd(recv, receiver_combi_cmd(recv, 1), cmd == CMDLINE_KEY_HELP, &res);
+                        if(ret != COMPLETE_AGAIN || !res.truncated || size > UINT_MAX / 2)
+                            break;
+                        size *= 2;
                     }
                     
-                    tmp_size = strnlen(tmp_buf, sizeof(tmp_buf));
-                    
                     //可补全
-                    if(ret == RECEIVER_RES_COMPLETE) 
+                    if(ret == COMPLETE_BUFFER) 
                     {
-                        for(i = 0; i < tmp_size; ++i) 
-                        {
-                            if(recv->left_buf.len >= INPUT_BUF_MAX_SIZE - 1)
-                                break;
-                            inputbuf_add_tail(&recv->left_buf, tmp_buf[i]);
-                            recv->write_char(recv, tmp_buf[i]);
-                        }
-                        display_right_buffer(recv, 1);
-                        return RECEIVER_RES_COMPLETE;
+                        gapbuf_insert(line, res.completion, strlen(res.completion));
+                        receiver_refresh(recv);
                     }
-                    
-                    //存在多种补全可能性
-                    receiver_puts(recv, "\r\n");
-                    while(ret)
+                    //存在多种补全可能性 逐一打印
+                    else if(ret == COMPLETE_AGAIN)
                     {
-                        recv->write_char(recv, ' ');
-                        for(i = 0; tmp_buf[i]; ++i)
-                            recv->write_char(recv, tmp_buf[i]);
+                        receiver_cursor_last_row(recv);
                         receiver_puts(recv, "\r\n");
-                        //多次complete来取得所有可能性并打印
-                        ret = recv->complete_cmd(recv, recv->all_cmd, &complete_state, tmp_buf, sizeof(tmp_buf));
+                        for(entry = complete_result_next(&res, NULL); entry; entry = complete_result_next(&res, entry))
+                        {
+                            recv->write_char(recv, ' ');
+                            receiver_puts(recv, entry);
+                            receiver_puts(recv, "\r\n");
+                        }
+                        //内存不足 无法记录所有选择
+                        if(res.truncated)
+                            receiver_puts(recv, " ...\r\n");
+                        //在新的一行重新显示
+                        recv->screen_row = 0;
+                        receiver_redisplay(recv);
                     }
-                    receiver_redisplay(recv);
+                    //无法补全 or 出错时不做处理
+                    free(arena);
                 }
                 return RECEIVER_RES_COMPLETE; 
             break;
@@ -415,88 +655,44 @@ receiver_parse_char(struct receiver* recv, char c)
             //alt 退格 / ctrl w - 删除光标左侧的第一个词
             case CMDLINE_KEY_META_BKSPACE:
             case CMDLINE_KEY_CTRL_W:
-                if(INPUT_BUF_IS_EMPTY(&recv->left_buf))
+                i = receiver_word_left(recv);
+                if(i == line->pos)
                     break;
-                inputbuf_init(&recv->paste_buf, recv->paste, INPUT_BUF_MAX_SIZE * 2);
-                while(!INPUT_BUF_IS_EMPTY(&recv->left_buf) &&
-                      (temp_char = inputbuf_get_tail(&recv->left_buf)) &&
-                      isblank(temp_char))
-                {
-                    inputbuf_add_head(&recv->paste_buf, temp_char);
-                    inputbuf_del_tail(&recv->left_buf);
-                    receiver_puts(recv, vt102_bs);
-                }
-                while(!INPUT_BUF_IS_EMPTY(&recv->left_buf) &&
-                      (temp_char = inputbuf_get_tail(&recv->left_buf)) &&
-                      !isblank(temp_char))
-                {
-                    inputbuf_add_head(&recv->paste_buf, temp_char);
-                    inputbuf_del_tail(&recv->left_buf);
-                    receiver_puts(recv, vt102_bs);
-                }
-                display_right_buffer(recv, 1);
+                receiver_cut(recv, i, line->pos - i);
+                gapbuf_del_left(line, line->pos - i);
+                receiver_refresh(recv);
             break;
             
             //alt d - 删除光标右侧的第一个词
             case CMDLINE_KEY_META_D:
-                if(INPUT_BUF_IS_EMPTY(&recv->right_buf))
+                i = receiver_word_right(recv);
+                if(i == line->pos)
                     break;
-                inputbuf_init(&recv->paste_buf, recv->paste, INPUT_BUF_MAX_SIZE * 2);
-                while(!INPUT_BUF_IS_EMPTY(&recv->right_buf) &&
-                      (temp_char = inputbuf_get_head(&recv->right_buf)) &&
-                      isblank(temp_char))
-                {
-                    inputbuf_add_tail(&recv->paste_buf, temp_char);
-                    inputbuf_del_head(&recv->right_buf);
-                }
-                while(!INPUT_BUF_IS_EMPTY(&recv->right_buf) &&
-                      (temp_char = inputbuf_get_head(&recv->right_buf)) &&
-                      !isblank(temp_char))
-                {
-                    inputbuf_add_tail(&recv->paste_buf, temp_char);
-                    inputbuf_del_head(&recv->right_buf);
-                }  
-                display_right_buffer(recv, 1);
+                receiver_cut(recv, line->pos, i - line->pos);
+                gapbuf_del_right(line, i - line->pos);
+                receiver_refresh(recv);
             break;
             
             //alt b - 光标向左移动到当前单词最前端
             case CMDLINE_KEY_WLEFT:
-                while(!INPUT_BUF_IS_EMPTY(&recv->left_buf) &&
-                      (temp_char = inputbuf_get_tail(&recv->left_buf)) &&
-                      isblank(temp_char))
-                {
-                    inputbuf_del_tail(&recv->left_buf);
-                    inputbuf_add_head(&recv->right_buf, temp_char);
-                    receiver_puts(recv, vt102_left_arr);
-                }
-                while(!INPUT_BUF_IS_EMPTY(&recv->left_buf) &&
-                      (temp_char = inputbuf_get_tail(&recv->left_buf)) &&
-                      !isblank(temp_char))
-                {
-                    inputbuf_del_tail(&recv->left_buf);
-                    inputbuf_add_head(&recv->right_buf, temp_char);
-                    receiver_puts(recv, vt102_left_arr);
-                }
+                gapbuf_set_pos(line, receiver_word_left(recv));
+                receiver_refresh(recv);
             break;
             
             //alt f - 光标向右移动到当前单词最后端
             case CMDLINE_KEY_WRIGHT:
-                while(!INPUT_BUF_IS_EMPTY(&recv->right_buf) &&
-                      (temp_char = inputbuf_get_head(&recv->right_buf)) &&
-                      isblank(temp_char))
-                {
-                    inputbuf_del_head(&recv->right_buf);
-                    inputbuf_add_tail(&recv->left_buf, temp_char);
-                    receiver_puts(recv, vt102_right_arr);
-                }
-                while(!INPUT_BUF_IS_EMPTY(&recv->right_buf) &&
-                      (temp_char = inputbuf_get_head(&recv->right_buf)) &&
-                      !isblank(temp_char))
-                {
-                    inputbuf_del_head(&recv->right_buf);
-                    inputbuf_add_tail(&recv->left_buf, temp_char);
-                    receiver_puts(recv, vt102_right_arr);
-                } 
+                gapbuf_set_pos(line, receiver_word_right(recv));
+                receiver_refresh(recv);
+            break;
+
+            //ctrl r - 进入历史搜索模式
+            case CMDLINE_KEY_CTRL_R:
+                history_sync_shared(&recv->hist);
+                recv->search_mode = 1;
+                recv->search_len = 0;
+                recv->search_idx = -1;
+                recv->search_fail = 0;
+                receiver_search_display(recv);
             break;
         }
         return RECEIVER_RES_SUCCESS;
@@ -505,13 +701,53 @@ receiver_parse_char(struct receiver* recv, char c)
     //字符c非控制码
     if(!isprint((int)c))//不可打印
         return RECEIVER_RES_SUCCESS;
-    if(inputbuf_add_tail(&recv->left_buf, c) < 0)//左缓冲区溢出
+    if(gapbuf_insert(line, &c, 1) == 0)//输入缓冲区溢出
         return RECEIVER_RES_SUCCESS;
-    recv->write_char(recv, c);
-    display_right_buffer(recv, 0);
+    receiver_refresh(recv);
     return RECEIVER_RES_SUCCESS;
 }
 
+int
+receiver_parse_chars(struct receiver* recv, const char* buf, unsigned int size)
+{
+    if(!recv || !buf)
+        return -EINVAL;
+    if(recv->status == RECEIVER_EXITED)
+        return RECEIVER_RES_EXITED;
+    if(recv->status != RECEIVER_RUNNING)
+        return RECEIVER_RES_NOT_RUNNING;
+
+    unsigned int n;
+
+    //控制码解析中或处于历史搜索模式 交由receiver_parse_char()继续处理
+    if(recv->vt102.status != PARSER_VT102_INIT || recv->search_mode)
+        return 0;
+
+    //括号粘贴中 连续的可打印字符(包括'?'等按键)一次插入 粘贴结束时才刷新显示
+    if(recv->pasting)
+    {
+        for(n = 0; n < size && buf[n] >= 040 && buf[n] < 0177; ++n)
+            ;
+        if(n > 0)
+        {
+            recv->paste_cr = 0;
+            gapbuf_insert(&recv->line_buf, buf, n);
+        }
+        return n;
+    }
+
+    //统计连续的普通可打印字符 每个字符只查一次表
+    for(n = 0; n < size && PARSER_VT102_CLASS(buf[n]) == PARSER_VT102_CLASS_PRINT; ++n)
+        ;
+    if(n == 0)
+        return 0;
+
+    //批量插入输入缓冲区 溢出的部分丢弃
+    if(gapbuf_insert(&recv->line_buf, buf, n) > 0)
+        receiver_refresh(recv);
+    return n;
+}
+
 void
 receiver_redisplay(struct receiver* recv)
 {
@@ -519,46 +755,205 @@ receiver_redisplay(struct receiver* recv)
         return;
     
     unsigned int i;
-    char temp_char;
 
+    //回到prompt所在行的行首
+    if(recv->screen_row > 0)
+        receiver_miniprintf(recv, vt102_multi_up, recv->screen_row);
     receiver_puts(recv, vt102_home);
     for(i = 0; i < recv->prompt_size; ++i)
         recv->write_char(recv, recv->prompt[i]);
-    INPUTBUF_FOREACH(&recv->left_buf, i, temp_char)
+    receiver_wrap(recv, recv->prompt_size);
+
+    //屏幕上原有的内容全部重新输出 分多行显示时清除下方的所有行
+    recv->shadow_len = 0;
+    recv->shadow_pos = 0;
+    recv->shadow_valid = 1;
+    receiver_emit(recv, 0, recv->line_buf.len);
+    receiver_puts(recv, recv->cols ? vt102_clear_down : vt102_clear_right);
+    receiver_cursor_to(recv, recv->line_buf.pos);
+}
+
+void
+receiver_refresh(struct receiver* recv)
+{
+    if(!recv)
+        return;
+
+    struct gapbuf* line = &recv->line_buf;
+    unsigned int p, end;
+
+    if(!recv->shadow_valid)
+    {
+        receiver_redisplay(recv);
+        return;
+    }
+
+    //与屏幕内容相同的前缀 长度不变时同时跳过相同的后缀
+    for(p = 0; p < line->len && p < recv->shadow_len && recv->shadow[p] == GAPBUF_AT(line, p); ++p)
+        ;
+    end = line->len;
+    if(line->len == recv->shadow_len)
+    {
+        while(end > p && recv->shadow[end - 1] == GAPBUF_AT(line, end - 1))
+            --end;
+    }
+
+    //只输出不同的部分
+    if(p < end)
     {
-        recv->write_char(recv, temp_char);
+        receiver_cursor_to(recv, p);
+        receiver_emit(recv, p, end - p);
     }
-    display_right_buffer(recv, 1);
+    //屏幕内容较长 清除多余部分 只多一个字符且不在行尾时用空格覆盖
+    //多余部分跨行时清除下方的所有行
+    if(recv->shadow_len > line->len)
+    {
+        receiver_cursor_to(recv, line->len);
+        if(recv->shadow_len - line->len == 1 && receiver_row_of(recv, line->len + 1) == recv->screen_row)
+        {
+            recv->write_char(recv, ' ');
+            ++recv->shadow_pos;
+        }
+        else if(receiver_row_of(recv, recv->shadow_len - 1) > recv->screen_row)
+        {
+            receiver_puts(recv, vt102_clear_down);
+        }
+        else
+        {
+            receiver_puts(recv, vt102_clear_right);
+        }
+        recv->shadow_len = line->len;
+    }
+    receiver_cursor_to(recv, line->pos);
 }
 
 static void
-receiver_puts(struct receiver* recv, const char* str)
+receiver_search_display(struct receiver* recv)
 {
-    if(!recv || !str)
-        return;
-
-    size_t len = strnlen(str, INPUT_BUF_MAX_SIZE), i;
-    for(i = 0; i < len; ++i)
-        recv->write_char(recv, str[i]);
+    const char* label;
+    const char* match;
+    unsigned int len;
+    int i;
+
+    //覆盖了输入内容 退出搜索时重新显示整行
+    recv->shadow_valid = 0;
+    if(recv->screen_row > 0)
+        receiver_miniprintf(recv, vt102_multi_up, recv->screen_row);
+    receiver_puts(recv, vt102_home);
+    label = recv->search_fail ? "(failed reverse-i-search)`" : "(reverse-i-search)`";
+    receiver_puts(recv, label);
+    for(i = 0; i < recv->search_len; ++i)
+        recv->write_char(recv, recv->search_buf[i]);
+    receiver_puts(recv, "': ");
+    len = strlen(label) + recv->search_len + 3;
+    if((match = history_get_cmd(&recv->hist, recv->search_idx)) != NULL)
+    {
+        receiver_puts(recv, match);
+        len += strlen(match);
+    }
+    receiver_wrap(recv, len);
+    receiver_puts(recv, recv->cols ? vt102_clear_down : vt102_clear_right);
 }
 
+/*
+* 内部函数 从序号before之前查找搜索内容 未找到时保留当前匹配
+*/
 static void
-display_right_buffer(struct receiver* recv, int force)
+receiver_search_update(struct receiver* recv, int before)
 {
-    if(!recv || (!force && INPUT_BUF_IS_EMPTY(&recv->right_buf)))
+    int idx;
+
+    if(recv->search_len == 0)
+    {
+        recv->search_idx = -1;
+        recv->search_fail = 0;
         return;
+    }
+    idx = history_search(&recv->hist, recv->search_buf, recv->search_len, before);
+    recv->search_fail = idx < 0;
+    if(idx >= 0)
+        recv->search_idx = idx;
+    else
+        receiver_puts(recv, vt102_bell);
+}
 
-    unsigned int i;
-    char c;
+static int
+receiver_search_key(struct receiver* recv, int cmd, char c)
+{
+    const char* match;
 
-    //消除光标右部数据并再次显示
-    receiver_puts(recv, vt102_clear_right);
-    INPUTBUF_FOREACH(&recv->right_buf, i, c) 
+    switch(cmd)
     {
-        recv->write_char(recv, c);
+        //ctrl r - 查找更早的匹配
+        case CMDLINE_KEY_CTRL_R:
+            receiver_search_update(recv, recv->search_idx >= 0 ? recv->search_idx : recv->hist.history_cmd_num);
+        break;
+
+        //退格 - 删除搜索内容的最后一个字符 从最新的命令重新查找
+        case CMDLINE_KEY_BKSPACE:
+            if(recv->search_len > 0)
+                --recv->search_len;
+            recv->search_idx = -1;
+            receiver_search_update(recv, recv->hist.history_cmd_num);
+        break;
+
+        //ctrl g / ctrl c - 取消搜索 恢复原有输入
+        case CMDLINE_KEY_CTRL_G:
+        case CMDLINE_KEY_CTRL_C:
+            recv->search_mode = 0;
+            receiver_redisplay(recv);
+            return 0;
+
+        //?在搜索模式下为普通字符
+        case CMDLINE_KEY_HELP:
+        case PARSER_VT102_CHAR:
+            if(!isprint((int)c) || recv->search_len >= (int)recv->line_buf.max)
+                return 0;
+            if(receiver_reserve(&recv->search_buf, &recv->search_cap, recv->search_len + 1) < 0)
+                return 0;
+            recv->search_buf[recv->search_len++] = c;
+            //当前匹配仍包含新的搜索内容时保持不变
+            receiver_search_update(recv, recv->search_idx >= 0 ? recv->search_idx + 1 : recv->hist.history_cmd_num);
+        break;
+
+        //其他按键 - 接受当前匹配 之后按普通模式处理按键
+        default:
+            recv->search_mode = 0;
+            if((match = history_get_cmd(&recv->hist, recv->search_idx)) != NULL)
+            {
+                gapbuf_clear(&recv->line_buf);
+                gapbuf_insert(&recv->line_buf, match, strlen(match));
+            }
+            receiver_redisplay(recv);
+            return 1;
     }
-    if(!INPUT_BUF_IS_EMPTY(&recv->right_buf))
-        receiver_miniprintf(recv, vt102_multi_left, (recv->right_buf).len);
+    receiver_search_display(recv);
+    return 0;
+}
+
+static void
+receiver_wrap(struct receiver* recv, unsigned int pos)
+{
+    if(!recv->cols)
+    {
+        recv->screen_row = 0;
+        return;
+    }
+    recv->screen_row = pos / recv->cols;
+    //恰好写满一行时终端光标停留在行尾 换行使光标位于下一行行首
+    if(pos > 0 && pos % recv->cols == 0)
+        receiver_puts(recv, "\r\n");
+}
+
+static void
+receiver_puts(struct receiver* recv, const char* str)
+{
+    if(!recv || !str)
+        return;
+
+    size_t len = strlen(str), i;
+    for(i = 0; i < len; ++i)
+        recv->write_char(recv, str[i]);
 }
 
 /* a very very basic printf with one arg and one format 'u' */
@@ -568,7 +963,8 @@ receiver_miniprintf(struct receiver* recv, const char* buf, unsigned int val)
     if(!recv || !buf)
         return;
 
-    char c, started=0, div=100;
+    char c, digits[10];
+    int n;
 
     while((c = *(buf++))) 
     {
@@ -584,18 +980,15 @@ receiver_miniprintf(struct receiver* recv, const char* buf, unsigned int val)
             recv->write_char(recv, c);
             continue;
         }
-        /* val is never more than 255 */
-        while (div) 
+        //从低位开始取出各位数字 倒序输出
+        n = 0;
+        do
         {
-            c = (char)(val / div);
-            if (c || started) 
-            {
-                recv->write_char(recv, (char)(c+'0'));
-                started = 1;
-            }
-            val %= div;
-            div /= 10;
-        }
+            digits[n++] = (char)(val % 10 + '0');
+            val /= 10;
+        } while(val);
+        while(n)
+            recv->write_char(recv, digits[--n]);
     }
 }
 
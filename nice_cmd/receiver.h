@@ -35,9 +35,10 @@
 #ifndef _RECEIVER_H_
 #define _RECEIVER_H_
 
-#include<nice_cmd/inputbuf.h>
+#include<nice_cmd/gapbuf.h>
 #include<nice_cmd/history.h>
 #include<nice_cmd/parser_vt102.h>
+#include<nice_cmd/parse.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -48,19 +49,29 @@ extern "C"
 * 配置宏
 */
 #define PROMPT_MAX_SIZE 32
-#define INPUT_BUF_MAX_SIZE 512
+#define INPUT_BUF_MAX_SIZE 4096
 #define HISTORY_MAX_NUM 20
 
+/*
+* 括号粘贴(bracketed paste)模式
+*    RECEIVER_PASTE_OFF: 不开启 终端仍发送粘贴标记时按INSERT处理
+* RECEIVER_PASTE_INSERT: 粘贴内容整体插入输入缓冲区 换行/tab替换为空格
+*   RECEIVER_PASTE_EXEC: 粘贴内容中的每个换行都执行当前行 逐行作为命令执行
+*/
+#define RECEIVER_PASTE_OFF    0
+#define RECEIVER_PASTE_INSERT 1
+#define RECEIVER_PASTE_EXEC   2
+
 /*
 * 接收器配套回调函数
 *   func_write_char: 设定字符如何write至输出流
 *    func_parse_cmd: 解析字符串
-* func_complete_cmd: 补全字符串
+* func_complete_cmd: 补全字符串 一次调用取得所有选择 (参照parse.h中的complete())
 */
 struct receiver;
 typedef int (func_write_char)(struct receiver*, char);
 typedef void (func_parse_cmd)(struct receiver*, const char*);
-typedef int (func_complete_cmd)(struct receiver*, const char*, int*, char*, unsigned int);
+typedef int (func_complete_cmd)(struct receiver*, const char*, int, struct complete_result*);
 
 /*
 * 接收器状态
@@ -83,16 +94,37 @@ enum receiver_status
 *
 *       vt102: vt102控制码解析器
 *
-*    left_buf: 输入缓冲区的左部分
-*        left: 左缓冲配套的内存
-*   right_buf: 输入缓冲区的右部分
-*       right: 右缓冲配套的内存
-*     all_cmd: 完整的命令 用于解析
+*    line_buf: 输入缓冲区 间隙缓冲区 光标即为间隙缓冲区的光标
+*              按需扩容 长度上限默认为INPUT_BUF_MAX_SIZE
 *
-*   paste_buf: 粘贴缓冲区 储存ctrl k等删除的内容
-*       paste: 粘贴缓冲区配套的内容
+*       paste: 粘贴缓冲区 储存ctrl k等删除的内容(malloc/按需扩容)
+*   paste_len: 粘贴缓冲区内容长度
+*   paste_cap: 粘贴缓冲区容量
+*
+*  paste_mode: 括号粘贴模式 RECEIVER_PASTE_*
+*     pasting: 是否处于括号粘贴中 即收到ESC[200~之后 ESC[201~之前
+*    paste_cr: 粘贴中上一个字符是否为'\r' 用于将"\r\n"视为一个换行
+*              粘贴中只修改输入缓冲区 粘贴结束时统一刷新显示
+*
+*      shadow: 屏幕上prompt之后显示的内容(malloc/按需扩容) 刷新时与输入缓冲区比对
+*  shadow_len: 屏幕上显示的内容长度
+*  shadow_cap: shadow的容量
+*  shadow_pos: 屏幕上的光标位置 即光标与prompt结尾之间的列数
+*shadow_valid: shadow是否与屏幕一致 不一致时(历史搜索等)刷新时重新显示整行
+*        cols: 终端宽度(列数) 为0时宽度未知 按不换行处理
+*  screen_row: 屏幕上的光标所在行 即光标与prompt所在行之间的行数
+*              超过终端宽度的命令分多行显示 光标按行/列移动
 *
 *        hist: 历史记录系统
+* hist_prefix: 上箭头查询历史记录时使用的前缀长度
+*              前缀为开始查询时光标左侧的内容 储存在hist.user_input_buf的开头
+*
+* search_mode: 是否处于ctrl r历史搜索模式
+*  search_buf: 搜索内容(malloc/按需扩容)
+*  search_len: 搜索内容长度
+*  search_cap: 搜索内容缓冲区容量
+*  search_idx: 当前匹配的历史命令序号 -1为无匹配
+* search_fail: 最近一次搜索是否失败
 *
 *  write_char: 输出字符
 *   parse_cmd: 解析命令
@@ -108,16 +140,33 @@ struct receiver
     //控制码解析器
     struct parser_vt102 vt102; 
     //输入缓冲区
-    struct inputbuf left_buf;
-    char left[INPUT_BUF_MAX_SIZE];
-    struct inputbuf right_buf;
-    char right[INPUT_BUF_MAX_SIZE];
-    char all_cmd[INPUT_BUF_MAX_SIZE * 2];
+    struct gapbuf line_buf;
     //粘贴缓冲区 储存ctrl k等删除的内容
-    struct inputbuf paste_buf;
-    char paste[INPUT_BUF_MAX_SIZE * 2];
+    char* paste;
+    unsigned int paste_len;
+    unsigned int paste_cap;
+    //括号粘贴
+    int paste_mode;
+    int pasting;
+    int paste_cr;
+    //屏幕内容
+    char* shadow;
+    unsigned int shadow_len;
+    unsigned int shadow_cap;
+    unsigned int shadow_pos;
+    int shadow_valid;
+    unsigned int cols;
+    unsigned int screen_row;
     //历史记录
     struct history hist;
+    int hist_prefix;
+    //ctrl r历史搜索
+    int search_mode;
+    char* search_buf;
+    int search_len;
+    unsigned int search_cap;
+    int search_idx;
+    int search_fail;
     //回调函数
     func_write_char* write_char;
     func_parse_cmd* parse_cmd;
@@ -130,6 +179,24 @@ struct receiver
 */
 int receiver_init(struct receiver* recv, func_write_char* write_char, func_parse_cmd* parse_cmd, func_complete_cmd* complete_cmd);
 
+/*
+* 设置单条命令的长度上限 同时作为历史记录单条命令的长度上限
+* 缓冲区按需扩容 不会预先分配上限大小的内存
+* 返回0为成功 max小于当前输入长度时失败
+*/
+int receiver_set_line_max(struct receiver* recv, unsigned int max);
+
+/*
+* 设置终端宽度(列数) 为0时按不换行处理
+* 命令行运行中宽度改变时重新显示整行
+*/
+void receiver_set_width(struct receiver* recv, unsigned int cols);
+
+/*
+* 释放接收器的缓冲区及历史记录
+*/
+void receiver_free(struct receiver* recv);
+
 /*
 * 创建新的命令行
 * 对缓冲区进行重置/输出prompt
@@ -143,9 +210,10 @@ int receiver_new_cmdline(struct receiver* recv, const char* prompt);
 void receiver_quit(struct receiver* recv);
 
 /*
-* 对接收器缓冲区的字符串进行组合
-* mode = 0时为组合左右缓冲区
-* mode = 1时为仅组合左缓冲区
+* 获取接收器缓冲区中的连续命令 不进行copy
+* mode = 0时为完整的命令 以"\n\0"结尾
+* mode = 1时为光标左侧的内容 以'\0'结尾
+* 返回值在下一次编辑前有效
 */
 const char* receiver_combi_cmd(struct receiver* recv, int mode);
 
@@ -163,10 +231,26 @@ const char* receiver_combi_cmd(struct receiver* recv, int mode);
 int receiver_parse_char(struct receiver* recv, char c);
 
 /*
-* 重新显示当前命令行
+* 对输入的连续可打印字符进行批量处理
+* 从buf起始处取出不构成控制码的连续可打印字符
+* 一次性加入缓冲区并只刷新一次光标右侧显示
+*
+* 返回值为已处理的字符数 为0时说明buf首字符需由receiver_parse_char()处理
+* 负数按上面宏定义解释
+*/
+int receiver_parse_chars(struct receiver* recv, const char* buf, unsigned int size);
+
+/*
+* 重新显示当前命令行 输出prompt及整行内容
 */
 void receiver_redisplay(struct receiver* recv);
 
+/*
+* 按输入缓冲区刷新屏幕 只输出与屏幕上的内容不同的部分
+* 光标移动选择输出最少的方式
+*/
+void receiver_refresh(struct receiver* recv);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,414 @@
+/*************************************************************************
+	> File Name: script.c
+	> Author: ZHJ
+	> Remarks: 脚本执行 不经过接收器直接对每行命令进行解析
+	> Created Time: Sat 17 Oct 2026 04:05:37 PM CST
+ ************************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<pthread.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include"script.h"
+
+/*
+* 切分后的脚本
+*
+* lines: 各行的起始位置 指向脚本内部 最后一行指向tail
+*    nb: 行数
+*  tail: 最后一行的copy 按其长度分配(malloc/需free)
+*/
+struct script_lines
+{
+    const char** lines;
+    unsigned int nb;
+    char* tail;
+};
+
+/*
+* 检查线程的参数
+*
+*      cl: 使用其命令组及命令索引进行匹配
+*   lines: 所有行
+*    errs: 各行的检查结果 与parse()返回值相同
+*   begin: 负责的第一行
+*     end: 负责的最后一行之后
+*     tid: 线程id
+* started: 线程是否创建成功
+*/
+struct script_worker
+{
+    struct cmdline* cl;
+    const char** lines;
+    int* errs;
+    unsigned int begin;
+    unsigned int end;
+    pthread_t tid;
+    int started;
+};
+
+/*
+* 内部函数 返回解析结果对应的错误信息
+*/
+static const char*
+script_strerror(int ret)
+{
+    switch(ret)
+    {
+        case PARSE_AMBIGUOUS:
+            return "Ambiguous command";
+        case PARSE_NOMATCH:
+            return "Command not found";
+        case PARSE_BAD_ARGS:
+            return "Bad arguments";
+        default:
+            return "Invalid line";
+    }
+}
+
+/*
+* 内部函数 输出出错的行
+*/
+static void
+script_report(struct cmdline* cl, const char* name, unsigned int lineno, int ret)
+{
+    if(name)
+        cmdline_printf(cl, "%s:%u: %s\n", name, lineno, script_strerror(ret));
+    else
+        cmdline_printf(cl, "line %u: %s\n", lineno, script_strerror(ret));
+}
+
+/*
+* 内部函数 释放切分后的脚本
+*/
+static void
+script_lines_free(struct script_lines* lines)
+{
+    free(lines->lines);
+    free(lines->tail);
+    lines->lines = NULL;
+    lines->tail = NULL;
+    lines->nb = 0;
+}
+
+/*
+* 内部函数 将buf切分为行 不进行copy
+* 最后一行之后的内容不一定可读(parse()会读取换行符之后的一个字符)
+* 因此最后一行copy至lines->tail 并补上换行符
+* 
+* 返回0为成功 -1为失败
+*/
+static int
+script_split(struct script_lines* lines, const char* buf, size_t size)
+{
+    const char* p = buf;
+    const char* end = buf + size;
+    const char* eol;
+    const char** tmp;
+    unsigned int cap = 0;
+    size_t len;
+
+    lines->lines = NULL;
+    lines->nb = 0;
+    lines->tail = NULL;
+    while(p < end)
+    {
+        if(lines->nb == cap)
+        {
+            cap = cap ? cap * 2 : 1024;
+            tmp = realloc(lines->lines, cap * sizeof(const char*));
+            if(tmp == NULL)
+            {
+                script_lines_free(lines);
+                return -1;
+            }
+            lines->lines = tmp;
+        }
+
+        //以换行符结尾且不是最后一行 直接在buf上解析
+        eol = memchr(p, '\n', end - p);
+        if(eol && eol + 1 < end)
+        {
+            lines->lines[lines->nb++] = p;
+            p = eol + 1;
+            continue;
+        }
+
+        //最后一行
+        len = eol ? (size_t)(eol - p) : (size_t)(end - p);
+        lines->tail = malloc(len + 2);
+        if(lines->tail == NULL)
+        {
+            script_lines_free(lines);
+            return -1;
+        }
+        memcpy(lines->tail, p, len);
+        lines->tail[len] = '\n';
+        lines->tail[len + 1] = '\0';
+        lines->lines[lines->nb++] = lines->tail;
+        p = end;
+    }
+    return 0;
+}
+
+/*
+* 内部函数 检查线程 检查[begin, end)中的各行
+*/
+static void*
+script_check_worker(void* arg)
+{
+    struct script_worker* w = arg;
+    unsigned int i;
+
+    for(i = w->begin; i < w->end; ++i)
+        w->errs[i] = parse_check(w->cl, w->lines[i]);
+    return NULL;
+}
+
+/*
+* 内部函数 多线程检查所有行 并按行号输出出错的行
+* 各线程负责连续的一段行 结果写入errs中各自的区域 无需加锁
+*
+* 返回值为出错的行数 -1为失败
+*/
+static int
+script_check(struct cmdline* cl, const char* name, struct script_lines* lines, int nb_threads)
+{
+    struct script_worker workers[SCRIPT_CHECK_THREAD_MAX];
+    unsigned int i, step;
+    int* errs;
+    int nb_err = 0;
+
+    //线程数 行数较少时减少线程
+    if(nb_threads <= 0)
+        nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(nb_threads <= 0)
+        nb_threads = 1;
+    if(nb_threads > SCRIPT_CHECK_THREAD_MAX)
+        nb_threads = SCRIPT_CHECK_THREAD_MAX;
+    if((unsigned int)nb_threads > lines->nb / SCRIPT_CHECK_MIN_LINES + 1)
+        nb_threads = lines->nb / SCRIPT_CHECK_MIN_LINES + 1;
+
+    errs = malloc((lines->nb ? lines->nb : 1) * sizeof(int));
+    if(errs == NULL)
+        return -1;
+
+    step = (lines->nb + nb_threads - 1) / nb_threads;
+    for(i = 0; i < (unsigned int)nb_threads; ++i)
+    {
+        workers[i].cl = cl;
+        workers[i].lines = lines->lines;
+        workers[i].errs = errs;
+        workers[i].begin = i * step < lines->nb ? i * step : lines->nb;
+        workers[i].end = workers[i].begin + step < lines->nb ? workers[i].begin + step : lines->nb;
+        workers[i].started = 0;
+    }
+    //第一段由当前线程检查 线程创建失败时同样由当前线程检查
+    for(i = 1; i < (unsigned int)nb_threads; ++i)
+    {
+        if(pthread_create(&workers[i].tid, NULL, script_check_worker, &workers[i]) == 0)
+            workers[i].started = 1;
+    }
+    for(i = 0; i < (unsigned int)nb_threads; ++i)
+    {
+        if(!workers[i].started)
+            script_check_worker(&workers[i]);
+    }
+    for(i = 1; i < (unsigned int)nb_threads; ++i)
+    {
+        if(workers[i].started)
+            pthread_join(workers[i].tid, NULL);
+    }
+
+    //按行号输出
+    for(i = 0; i < lines->nb; ++i)
+    {
+        if(errs[i] > 0)
+            continue;
+        ++nb_err;
+        script_report(cl, name, i + 1, errs[i]);
+    }
+    cmdline_flush(cl);
+    free(errs);
+
+    return nb_err;
+}
+
+/*
+* 内部函数 逐行执行buf中的命令
+*
+*         cl: cmdline结构体
+*       name: 输出错误时的前缀 为NULL时输出"line N"
+*        buf: 命令内容
+*       size: buf长度
+*      check: 为1时先检查所有行 存在出错的行时不执行任何命令
+* nb_threads: 检查使用的线程数
+*
+* 返回值为出错的行数 -1为失败
+*/
+static int
+script_run(struct cmdline* cl, const char* name, const char* buf, size_t size, int check, int nb_threads)
+{
+    struct script_lines lines;
+    unsigned int i;
+    int ret, nb_err = 0;
+
+    if(script_split(&lines, buf, size) < 0)
+        return -1;
+
+    if(check)
+    {
+        nb_err = script_check(cl, name, &lines, nb_threads);
+        if(nb_err != 0)
+        {
+            script_lines_free(&lines);
+            return nb_err;
+        }
+    }
+
+    for(i = 0; i < lines.nb && cl->cmd_recv.status != RECEIVER_EXITED; ++i)
+    {
+        //回调函数可能直接输出 先输出缓冲区中已有内容
+        cmdline_flush_wait(cl);
+        //返回0说明行中存在'\0'
+        ret = parse(cl, lines.lines[i]);
+        if(ret > 0)
+            continue;
+        ++nb_err;
+        script_report(cl, name, i + 1, ret);
+    }
+    cmdline_flush(cl);
+    script_lines_free(&lines);
+
+    return nb_err;
+}
+
+int
+cmdline_run_buffer(struct cmdline* cl, const char* buf, size_t size)
+{
+    if(!cl || !buf)
+        return 0;
+    return script_run(cl, NULL, buf, size, 0, 0);
+}
+
+int
+cmdline_run_buffer_checked(struct cmdline* cl, const char* buf, size_t size, int nb_threads)
+{
+    if(!cl || !buf)
+        return 0;
+    return script_run(cl, NULL, buf, size, 1, nb_threads);
+}
+
+/*
+* 内部函数 将无法mmap的文件(管道等)完整读入内存
+* 返回NULL为失败 成功时需free
+*/
+static char*
+script_read_all(int fd, size_t* size)
+{
+    char* buf = NULL;
+    char* tmp;
+    size_t cap = 0, len = 0;
+    ssize_t n;
+
+    while(1)
+    {
+        if(len == cap)
+        {
+            cap = cap ? cap * 2 : BUFSIZ;
+            tmp = realloc(buf, cap);
+            if(tmp == NULL)
+            {
+                free(buf);
+                return NULL;
+            }
+            buf = tmp;
+        }
+        n = read(fd, buf + len, cap - len);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            free(buf);
+            return NULL;
+        }
+        if(n == 0)
+            break;
+        len += n;
+    }
+    *size = len;
+    return buf;
+}
+
+/*
+* 内部函数 映射文件并执行
+*/
+static int
+script_run_file(struct cmdline* cl, const char* path, int check, int nb_threads)
+{
+    struct stat st;
+    char* buf;
+    size_t size;
+    int fd, ret;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return -1;
+    if(fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    //管道等无法mmap 读入内存后执行
+    if(!S_ISREG(st.st_mode))
+    {
+        buf = script_read_all(fd, &size);
+        close(fd);
+        if(buf == NULL)
+            return -1;
+        ret = script_run(cl, path, buf, size, check, nb_threads);
+        free(buf);
+        return ret;
+    }
+
+    //空文件
+    if(st.st_size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    size = st.st_size;
+    buf = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(buf == MAP_FAILED)
+        return -1;
+    madvise(buf, size, MADV_SEQUENTIAL);
+
+    ret = script_run(cl, path, buf, size, check, nb_threads);
+    munmap(buf, size);
+
+    return ret;
+}
+
+int
+cmdline_run_file(struct cmdline* cl, const char* path)
+{
+    if(!cl || !path)
+        return -1;
+    return script_run_file(cl, path, 0, 0);
+}
+
+int
+cmdline_run_file_checked(struct cmdline* cl, const char* path, int nb_threads)
+{
+    if(!cl || !path)
+        return -1;
+    return script_run_file(cl, path, 1, nb_threads);
+}
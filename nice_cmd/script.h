@@ -0,0 +1,74 @@
+/*************************************************************************
+	> File Name: script.h
+	> Author: ZHJ
+	> Remarks: 脚本执行 不经过接收器直接对每行命令进行解析
+	> Created Time: Sat 17 Oct 2026 03:58:21 PM CST
+ ************************************************************************/
+
+#ifndef _SCRIPT_H_
+#define _SCRIPT_H_
+
+#include<stddef.h>
+#include<nice_cmd/cmdline.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+* 检查脚本时的配置宏
+*     SCRIPT_CHECK_THREAD_MAX: 最大线程数
+*      SCRIPT_CHECK_MIN_LINES: 每个线程至少负责的行数 行数较少时不创建线程
+*/
+#define SCRIPT_CHECK_THREAD_MAX 64
+#define SCRIPT_CHECK_MIN_LINES 4096
+
+/*
+* 执行buf中的命令 每行一条
+* 不经过接收器 没有回显/光标处理/历史记录 直接调用parse()
+* 出错的行以"line N: 错误信息"的形式输出至cmdline的输出流 之后继续执行
+* 命令回调中调用cmdline_quit()时停止执行
+*
+*   cl: cmdline结构体 使用其命令组及输出流
+*  buf: 命令内容 不需以'\0'结尾
+* size: buf长度
+*
+* 返回值为出错的行数 -1为失败(内存不足)
+*/
+int cmdline_run_buffer(struct cmdline* cl, const char* buf, size_t size);
+
+/*
+* 先检查buf中的所有行 全部可以匹配时再依次执行
+* 检查由多个线程并行进行 仅匹配命令 不调用回调函数(参照parse_check())
+* 存在出错的行时输出所有出错的行 不执行任何命令
+* 
+* nb_threads: 检查使用的线程数 小于等于0时为CPU核数
+*
+* 返回值为出错的行数 -1为失败(内存不足)
+*/
+int cmdline_run_buffer_checked(struct cmdline* cl, const char* buf, size_t size, int nb_threads);
+
+/*
+* 执行文件中的命令 文件通过mmap映射 不进行copy
+* 非普通文件(管道等)会先读入内存
+* 出错的行以"path:N: 错误信息"的形式输出
+*
+*   cl: cmdline结构体
+* path: 文件路径
+*
+* 返回值为出错的行数 -1为文件无法读取
+*/
+int cmdline_run_file(struct cmdline* cl, const char* path);
+
+/*
+* 先并行检查文件中的所有行 全部可以匹配时再依次执行
+* 参照cmdline_run_buffer_checked()
+*/
+int cmdline_run_file_checked(struct cmdline* cl, const char* path, int nb_threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,333 @@
+/*************************************************************************
+	> File Name: server.c
+	> Author: ZHJ
+	> Remarks: 多会话命令行服务 通过socket为每个连接提供独立的cmdline
+	> Created Time: Sat 17 Oct 2026 10:40:18 AM CST
+ ************************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<signal.h>
+#include<unistd.h>
+#include<sys/socket.h>
+#include<sys/epoll.h>
+#include<sys/un.h>
+#include<netinet/in.h>
+#include<arpa/inet.h>
+#include"server.h"
+
+/*
+* 内部函数 分配服务并创建epoll实例
+* listen_fd需已处于监听状态
+*/
+static struct cmdline_server*
+server_alloc(parse_ctx_t* ctx, const char* prompt, int listen_fd)
+{
+    struct cmdline_server* srv;
+    struct epoll_event ev;
+
+    if(strlen(prompt) > PROMPT_MAX_SIZE - 1)
+        return NULL;
+
+    srv = malloc(sizeof(struct cmdline_server));
+    if(srv == NULL)
+        return NULL;
+    memset(srv, 0, sizeof(struct cmdline_server));
+
+    srv->cmd_group = ctx;
+    strcpy(srv->prompt, prompt);
+    srv->listen_fd = listen_fd;
+    srv->status = SERVER_RUNNING;
+
+    //命令索引只编译一次 由所有会话共享
+    srv->cmd_index = parse_index_new(ctx);
+    if(srv->cmd_index == NULL)
+    {
+        free(srv);
+        return NULL;
+    }
+    srv->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(srv->epoll_fd < 0)
+    {
+        parse_index_free(srv->cmd_index);
+        free(srv);
+        return NULL;
+    }
+
+    //监听socket的data.ptr为srv 以区分会话
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = srv;
+    if(epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0)
+    {
+        close(srv->epoll_fd);
+        parse_index_free(srv->cmd_index);
+        free(srv);
+        return NULL;
+    }
+
+    //连接断开后写入不应导致进程退出
+    signal(SIGPIPE, SIG_IGN);
+
+    return srv;
+}
+
+struct cmdline_server*
+cmdline_server_new_unix(parse_ctx_t* ctx, const char* prompt, const char* path)
+{
+    if(!prompt || !path || strlen(path) > SERVER_PATH_MAX_SIZE - 1)
+        return NULL;
+
+    struct cmdline_server* srv;
+    struct sockaddr_un addr;
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return NULL;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+       listen(fd, SERVER_LISTEN_BACKLOG) < 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    srv = server_alloc(ctx, prompt, fd);
+    if(srv == NULL)
+    {
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+    strcpy(srv->path, path);
+    return srv;
+}
+
+struct cmdline_server*
+cmdline_server_new_tcp(parse_ctx_t* ctx, const char* prompt, unsigned short port)
+{
+    if(!prompt)
+        return NULL;
+
+    struct cmdline_server* srv;
+    struct sockaddr_in addr;
+    int fd, on = 1;
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return NULL;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    //仅监听本地
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+       listen(fd, SERVER_LISTEN_BACKLOG) < 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    srv = server_alloc(ctx, prompt, fd);
+    if(srv == NULL)
+        close(fd);
+    return srv;
+}
+
+void
+cmdline_server_set_max(struct cmdline_server* srv, int max)
+{
+    if(!srv || max < 0)
+        return;
+    srv->session_max = max;
+}
+
+int
+cmdline_server_share_history(struct cmdline_server* srv, int max_num)
+{
+    if(!srv || srv->history)
+        return -1;
+    srv->history = history_shared_new(max_num, INPUT_BUF_MAX_SIZE);
+    return srv->history ? 0 : -1;
+}
+
+int
+cmdline_server_get_fd(struct cmdline_server* srv)
+{
+    if(!srv)
+        return -1;
+    return srv->epoll_fd;
+}
+
+/*
+* 内部函数 接受所有等待中的连接 并为其新建会话
+*/
+static void
+server_accept(struct cmdline_server* srv)
+{
+    struct cmdline_session* session;
+    struct cmdline* cl;
+    int fd;
+
+    while(1)
+    {
+        fd = accept4(srv->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+
+        //会话数超限
+        if(srv->session_max > 0 && srv->session_num >= srv->session_max)
+        {
+            close(fd);
+            continue;
+        }
+
+        session = malloc(sizeof(struct cmdline_session));
+        if(session == NULL)
+        {
+            close(fd);
+            continue;
+        }
+        cl = cmdline_get_new_index(srv->cmd_index, srv->prompt, fd, fd);
+        if(cl && srv->history)
+            cmdline_set_history_shared(cl, srv->history);
+        if(cl == NULL || cmdline_epoll_register(cl, srv->epoll_fd) < 0)
+        {
+            if(cl)
+                cmdline_exit_free(cl);
+            else
+                close(fd);
+            free(session);
+            continue;
+        }
+
+        //插入会话链表头部
+        session->cl = cl;
+        session->prev = NULL;
+        session->next = srv->sessions;
+        if(srv->sessions)
+            srv->sessions->prev = session;
+        srv->sessions = session;
+        ++srv->session_num;
+    }
+}
+
+/*
+* 内部函数 关闭指定cmdline对应的会话
+*/
+static void
+server_close_session(struct cmdline_server* srv, struct cmdline* cl)
+{
+    struct cmdline_session* session;
+
+    for(session = srv->sessions; session; session = session->next)
+    {
+        if(session->cl == cl)
+            break;
+    }
+    if(session == NULL)
+        return;
+
+    //移出会话链表
+    if(session->prev)
+        session->prev->next = session->next;
+    else
+        srv->sessions = session->next;
+    if(session->next)
+        session->next->prev = session->prev;
+    --srv->session_num;
+
+    cmdline_exit_free(cl);
+    free(session);
+}
+
+int
+cmdline_server_poll(struct cmdline_server* srv, int timeout)
+{
+    if(!srv)
+        return -1;
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    int n, i;
+
+    n = epoll_wait(srv->epoll_fd, events, SERVER_MAX_EVENTS, timeout);
+    if(n < 0)
+        return errno == EINTR ? 0 : -1;
+
+    for(i = 0; i < n; ++i)
+    {
+        //新连接
+        if(events[i].data.ptr == srv)
+        {
+            server_accept(srv);
+            continue;
+        }
+        //会话事件 退出或断开时回收
+        if(cmdline_epoll_handle(events[i].data.ptr, events[i].events) < 0)
+            server_close_session(srv, events[i].data.ptr);
+    }
+    return n;
+}
+
+void
+cmdline_server_run(struct cmdline_server* srv)
+{
+    if(!srv)
+        return;
+
+    while(srv->status == SERVER_RUNNING)
+    {
+        if(cmdline_server_poll(srv, -1) < 0)
+            break;
+    }
+}
+
+void
+cmdline_server_quit(struct cmdline_server* srv)
+{
+    if(!srv)
+        return;
+    srv->status = SERVER_EXITED;
+}
+
+void
+cmdline_server_free(struct cmdline_server* srv)
+{
+    if(!srv)
+        return;
+
+    struct cmdline_session* session;
+
+    //关闭所有会话
+    while((session = srv->sessions) != NULL)
+    {
+        srv->sessions = session->next;
+        cmdline_exit_free(session->cl);
+        free(session);
+    }
+    srv->session_num = 0;
+
+    close(srv->listen_fd);
+    close(srv->epoll_fd);
+    parse_index_free(srv->cmd_index);
+    history_shared_free(srv->history);
+    if(srv->path[0] != '\0')
+        unlink(srv->path);
+    free(srv);
+}
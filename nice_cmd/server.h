@@ -0,0 +1,148 @@
+/*************************************************************************
+	> File Name: server.h
+	> Author: ZHJ
+	> Remarks: 多会话命令行服务 通过socket为每个连接提供独立的cmdline
+	> Created Time: Sat 17 Oct 2026 10:12:40 AM CST
+ ************************************************************************/
+
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+#include<nice_cmd/cmdline.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+* 配置宏
+*/
+#define SERVER_PATH_MAX_SIZE 108
+#define SERVER_LISTEN_BACKLOG 16
+#define SERVER_MAX_EVENTS 64
+
+/*
+* 服务状态
+*/
+enum cmdline_server_status
+{
+    SERVER_RUNNING,
+    SERVER_EXITED
+};
+
+/*
+* 会话结构体 每个连接对应一个
+* 双向链表结构
+*
+*   cl: 此会话的cmdline 输入输出流均为连接的socket
+* prev: 上一个会话
+* next: 下一个会话
+*/
+struct cmdline_session
+{
+    struct cmdline* cl;
+    struct cmdline_session* prev;
+    struct cmdline_session* next;
+};
+
+/*
+* 命令行服务结构体
+* 所有会话由同一个epoll实例驱动 无需为会话创建线程
+* 其通过函数cmdline_server_new_unix()/cmdline_server_new_tcp()来新建
+*
+*   cmd_group: 所有会话共用的命令组
+*   cmd_index: 所有会话共享的命令索引
+*     history: 所有会话共享的历史记录 NULL为各会话独立
+*      prompt: 会话的提示符
+*   listen_fd: 监听socket
+*    epoll_fd: epoll实例
+*        path: unix socket路径 释放时unlink 为空时说明为tcp
+* session_num: 当前会话数
+* session_max: 最大会话数 0为无限制
+*    sessions: 会话链表
+*      status: 服务状态
+*/
+struct cmdline_server
+{
+    parse_ctx_t* cmd_group;
+    struct parse_index* cmd_index;
+    struct history_shared* history;
+    char prompt[PROMPT_MAX_SIZE];
+    int listen_fd;
+    int epoll_fd;
+    char path[SERVER_PATH_MAX_SIZE];
+    int session_num;
+    int session_max;
+    struct cmdline_session* sessions;
+    enum cmdline_server_status status;
+};
+
+/*
+* 新建监听unix domain socket的命令行服务
+* path已存在时会先将其删除
+*
+* 会话不修改终端设置 客户端需自行将终端设为raw模式 例如:
+*     socat -,raw,echo=0 UNIX-CONNECT:path
+* 服务会忽略SIGPIPE 以免连接断开时进程退出
+*
+* 返回NULL为失败
+*/
+struct cmdline_server* cmdline_server_new_unix(parse_ctx_t* ctx, const char* prompt, const char* path);
+
+/*
+* 新建监听127.0.0.1:port的命令行服务
+* 返回NULL为失败
+*/
+struct cmdline_server* cmdline_server_new_tcp(parse_ctx_t* ctx, const char* prompt, unsigned short port);
+
+/*
+* 设置最大会话数 超出时新连接会被直接关闭
+* max为0时无限制
+*/
+void cmdline_server_set_max(struct cmdline_server* srv, int max);
+
+/*
+* 使之后建立的会话共享历史记录 一个会话执行的命令可在其他会话中查询到
+*
+* max_num: 共享历史记录保留的命令数
+*
+* 返回0为成功 -1为失败
+*/
+int cmdline_server_share_history(struct cmdline_server* srv, int max_num);
+
+/*
+* 获取服务的epoll实例 可交给外部事件循环等待可读事件
+* 可读时调用cmdline_server_poll(srv, 0)
+*/
+int cmdline_server_get_fd(struct cmdline_server* srv);
+
+/*
+* 处理一轮事件 接受新连接/处理会话输入/回收已退出的会话
+*
+* timeout: 等待时间(ms) -1为一直等待
+*
+* 返回值为处理的事件数 -1为出错
+*/
+int cmdline_server_poll(struct cmdline_server* srv, int timeout);
+
+/*
+* 持续处理事件 直到cmdline_server_quit()被调用
+*/
+void cmdline_server_run(struct cmdline_server* srv);
+
+/*
+* 服务退出(SERVER_EXITED)
+*/
+void cmdline_server_quit(struct cmdline_server* srv);
+
+/*
+* 关闭所有会话及监听socket 并free服务
+*/
+void cmdline_server_free(struct cmdline_server* srv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif